@@ -0,0 +1,89 @@
+
+// reader for the binary output description of spright
+// https://github.com/houmain/spright
+//
+// The file can be memory mapped and accessed without parsing.
+// All values are little endian and 4-byte aligned.
+
+#ifndef SPRIGHT_BINARY_H
+#define SPRIGHT_BINARY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define SPRIGHT_BINARY_MAGIC 0x42525053 /* "SPRB" */
+#define SPRIGHT_BINARY_VERSION 1
+
+typedef struct {
+  int32_t x, y, w, h;
+} spright_rect;
+
+typedef struct {
+  float x, y;
+} spright_point;
+
+typedef struct {
+  uint32_t first, count;
+} spright_range;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sprite_count;
+  uint32_t texture_count;
+  uint32_t hash_size;
+  uint32_t vertex_count;
+  uint32_t string_table_size;
+
+  /* offsets from beginning of file */
+  uint32_t sprite_ids;               /* uint32_t[sprite_count] into string table */
+  uint32_t sprite_slice_indices;     /* int32_t[sprite_count], -1 when not packed */
+  uint32_t sprite_rects;             /* spright_rect[sprite_count] */
+  uint32_t sprite_trimmed_rects;     /* spright_rect[sprite_count] */
+  uint32_t sprite_pivots;            /* spright_point[sprite_count] */
+  uint32_t sprite_rotated;           /* uint32_t[sprite_count] */
+  uint32_t sprite_vertex_ranges;     /* spright_range[sprite_count] into vertices */
+  uint32_t vertices;                 /* spright_point[vertex_count] */
+  uint32_t hash_displacements;       /* int32_t[hash_size] */
+  uint32_t hash_slots;               /* uint32_t[hash_size] sprite indices */
+  uint32_t texture_filenames;        /* uint32_t[texture_count] into string table */
+  uint32_t texture_slice_indices;    /* int32_t[texture_count] */
+  uint32_t texture_sizes;            /* int32_t[texture_count][2] */
+  uint32_t texture_layers;           /* int32_t[texture_count] */
+  uint32_t string_table;             /* zero terminated UTF-8 strings */
+} spright_header;
+
+#define SPRIGHT_ARRAY(header, member, type) \
+  ((const type*)((const char*)(header) + (header)->member))
+
+static inline uint32_t spright_hash(uint32_t seed, const char* key) {
+  uint32_t hash = (seed ? seed : 2166136261u);
+  while (*key) {
+    hash ^= (uint8_t)*key++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static inline const char* spright_string(const spright_header* header, uint32_t offset) {
+  return SPRIGHT_ARRAY(header, string_table, char) + offset;
+}
+
+/* returns the index of the sprite with the id or -1 */
+static inline int32_t spright_find_sprite(const spright_header* header, const char* id) {
+  const int32_t* displacements = SPRIGHT_ARRAY(header, hash_displacements, int32_t);
+  const uint32_t* slots = SPRIGHT_ARRAY(header, hash_slots, uint32_t);
+  const uint32_t* ids = SPRIGHT_ARRAY(header, sprite_ids, uint32_t);
+  uint32_t slot;
+  int32_t displacement;
+  if (!header->hash_size)
+    return -1;
+  displacement = displacements[spright_hash(0, id) % header->hash_size];
+  slot = (displacement < 0 ? (uint32_t)(-displacement - 1) :
+    spright_hash((uint32_t)displacement, id) % header->hash_size);
+  if (strcmp(spright_string(header, ids[slots[slot]]), id) != 0)
+    return -1;
+  return (int32_t)slots[slot];
+}
+
+#endif /* SPRIGHT_BINARY_H */
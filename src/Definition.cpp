@@ -67,9 +67,14 @@ std::string_view get_definition_name(Definition definition) {
     case Definition::allow_rotate: return "allow-rotate";
     case Definition::padding: return "padding";
     case Definition::duplicates: return "duplicates";
+    case Definition::stable: return "stable";
     case Definition::alpha: return "alpha";
     case Definition::pack: return "pack";
     case Definition::scale: return "scale";
+    case Definition::compress: return "compress";
+    case Definition::mipmaps: return "mipmaps";
+    case Definition::array: return "array";
+    case Definition::palette: return "palette";
     case Definition::debug: return "debug";
     case Definition::path: return "path";
     case Definition::glob: return "glob";
@@ -109,6 +114,7 @@ std::string_view get_definition_name(Definition definition) {
     case Definition::rotate: return "rotate";
     case Definition::description: return "description";
     case Definition::template_: return "template";
+    case Definition::format: return "format";
   }
   return "-";
 }
@@ -146,11 +152,16 @@ Definition get_affected_definition(Definition definition) {
     case Definition::allow_rotate:
     case Definition::padding:
     case Definition::duplicates:
+    case Definition::stable:
     case Definition::pack:
       return Definition::sheet;
 
     case Definition::alpha:
     case Definition::scale:
+    case Definition::compress:
+    case Definition::mipmaps:
+    case Definition::array:
+    case Definition::palette:
     case Definition::debug:
       return Definition::output;
 
@@ -189,6 +200,7 @@ Definition get_affected_definition(Definition definition) {
       return Definition::transform;
 
     case Definition::template_:
+    case Definition::format:
       return Definition::description;
   }
   return Definition::none;
@@ -420,6 +432,13 @@ void apply_definition(Definition definition,
       break;
     }
 
+    case Definition::stable:
+      state.stable = true;
+      state.max_fragmentation = (arguments_left() ? check_real() : 0.25);
+      check(state.max_fragmentation >= 0 &&
+        state.max_fragmentation <= 1, "invalid fragmentation");
+      break;
+
     case Definition::alpha: {
       const auto string = check_string();
       if (const auto index = index_of(string, 
@@ -442,7 +461,7 @@ void apply_definition(Definition definition,
       const auto string = check_string();
       if (const auto index = index_of(string, 
           { "binpack", "rows", "columns", "compact", 
-            "origin", "single", "layers", "keep" }); index >= 0)
+            "origin", "single", "layers", "keep", "compact-physics" }); index >= 0)
         state.pack = static_cast<Pack>(index);
       else
         error("invalid pack method '", string, "'");
@@ -456,6 +475,34 @@ void apply_definition(Definition definition,
         check_resize_filter() : ResizeFilter::undefined);
       break;
 
+    case Definition::compress: {
+      const auto string = check_string();
+      if (const auto index = index_of(string, 
+          { "default", "none", "bc1", "bc3", "bc7", "etc2", "etc2a" }); index >= 0)
+        state.compression = static_cast<Compression>(index);
+      else
+        error("invalid compression '", string, "'");
+      break;
+    }
+
+    case Definition::mipmaps:
+      // zero levels generate the full chain, one level only the base level
+      state.mipmap_levels = (arguments_left() ? check_uint() : 0);
+      state.mipmap_bleed_free_level = (arguments_left() ? check_uint() : 0);
+      check(state.mipmap_bleed_free_level < 16, "invalid bleed-free level");
+      state.mipmaps = true;
+      break;
+
+    case Definition::array:
+      state.array = check_bool(true);
+      break;
+
+    case Definition::palette:
+      state.palette_colors = (arguments_left() ? check_uint() : 256);
+      check(state.palette_colors >= 2 && state.palette_colors <= 256, 
+        "invalid palette color count");
+      break;
+
     case Definition::debug:
       state.debug = check_bool(true);
       break;
@@ -589,10 +636,15 @@ void apply_definition(Definition definition,
     case Definition::trim: {
       const auto string = check_string();
       if (const auto index = index_of(string, 
-          { "none", "rect", "convex" }); index >= 0)
+          { "none", "rect", "convex", "polygon" }); index >= 0)
         state.trim = static_cast<Trim>(index);
       else
         error("invalid trim value '", string, "'");
+
+      if (state.trim == Trim::polygon && arguments_left()) {
+        state.trim_max_vertices = check_uint();
+        check(state.trim_max_vertices >= 3, "invalid vertex count");
+      }
       break;
     }
 
@@ -685,6 +737,16 @@ void apply_definition(Definition definition,
       state.template_filename = check_path();
       break;
 
+    case Definition::format: {
+      const auto string = check_string();
+      if (const auto index = index_of(string, 
+          { "default", "json", "cbor", "msgpack", "ubjson", "binary" }); index >= 0)
+        state.description_format = static_cast<DescriptionFormat>(index);
+      else
+        error("invalid description format '", string, "'");
+      break;
+    }
+
     case Definition::MAX:
     case Definition::none:
       break;
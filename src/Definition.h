@@ -22,9 +22,14 @@ enum class Definition {
   allow_rotate,
   padding,
   duplicates,
+  stable,
   alpha,
   pack,
   scale,
+  compress,
+  mipmaps,
+  array,
+  palette,
   debug,
 
   path,
@@ -68,6 +73,7 @@ enum class Definition {
 
   description,
   template_,
+  format,
 
   MAX
 };
@@ -90,11 +96,19 @@ struct State {
   int border_padding{ };
   int shape_padding{ };
   Duplicates duplicates{ };
+  bool stable{ };
+  real max_fragmentation{ };
   Alpha alpha{ };
   RGBA alpha_color{ };
   Pack pack{ };
   real scale{ 1.0 };
   ResizeFilter scale_filter{ };
+  Compression compression{ };
+  bool mipmaps{ };
+  int mipmap_levels{ };
+  int mipmap_bleed_free_level{ };
+  bool array{ };
+  int palette_colors{ };
   bool debug{ };
 
   std::filesystem::path path;
@@ -122,6 +136,7 @@ struct State {
   int trim_threshold{ 1 };
   int trim_margin{ };
   bool trim_gray_levels{ };
+  int trim_max_vertices{ 24 };
   bool crop{ };
   bool crop_pivot{ };
   Extrude extrude{ };
@@ -136,6 +151,7 @@ struct State {
 
   std::filesystem::path description_filename;
   std::filesystem::path template_filename;
+  DescriptionFormat description_format{ };
 };
 
 Definition get_definition(std::string_view command);
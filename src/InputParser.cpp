@@ -1,11 +1,14 @@
 
 #include "InputParser.h"
 #include "globbing.h"
+#include "archive.h"
+#include "packing.h"
 #include <charconv>
 #include <algorithm>
 #include <cstring>
 #include <utility>
 #include <iterator>
+#include <numeric>
 
 namespace spright {
 
@@ -15,13 +18,16 @@ namespace {
 
   ImageFilePtr try_get_map(const ImageFilePtr& source, 
       const std::string& default_map_suffix, 
-      const std::string& map_suffix) {
+      const std::string& map_suffix,
+      const std::filesystem::path& image_cache_path) {
 
     auto map_filename = replace_suffix(source->filename(), 
       default_map_suffix, map_suffix);
 
-    if (std::filesystem::exists(map_filename))
-      return std::make_shared<ImageFile>(source->path(), map_filename);
+    if (source_exists(source->path() / map_filename))
+      return std::make_shared<ImageFile>(load_image(
+        source->path() / map_filename, image_cache_path),
+        source->path(), map_filename);
     return { };
   }
 
@@ -130,7 +136,7 @@ ImageFilePtr InputParser::get_source(const std::filesystem::path& path,
     const std::filesystem::path& filename, RGBA colorkey) {
   auto& source = m_sources[std::filesystem::weakly_canonical(path / filename)];
   if (!source) {
-    auto image = load_image(path / filename);
+    auto image = load_image(path / filename, m_settings.image_cache_path);
 
     if (colorkey != RGBA{ }) {
       if (!colorkey.a)
@@ -160,8 +166,8 @@ MapVectorPtr InputParser::get_maps(const State& state, const ImageFilePtr& sourc
   if (it == m_maps.end()) {
     auto maps = std::vector<ImageFilePtr>();
     for (const auto& map_suffix : state.map_suffixes)
-      maps.push_back(try_get_map(source, 
-        state.default_map_suffix, map_suffix));
+      maps.push_back(try_get_map(source, state.default_map_suffix, 
+        map_suffix, m_settings.image_cache_path));
     it = m_maps.emplace(source, 
       std::make_shared<decltype(maps)>(std::move(maps))).first;
   }
@@ -221,6 +227,7 @@ void InputParser::sprite_ends(State& state) {
   sprite.trim_margin = state.trim_margin;
   sprite.trim_threshold = state.trim_threshold;
   sprite.trim_gray_levels = state.trim_gray_levels;
+  sprite.trim_max_vertices = state.trim_max_vertices;
   sprite.crop = state.crop;
   sprite.crop_pivot = state.crop_pivot;
   sprite.extrude = state.extrude;
@@ -304,10 +311,9 @@ void InputParser::deduce_sequence_sprites(State& state) {
       continue;
     }
 
-    auto error = std::error_code{ };
     if (state.source_filenames.is_infinite_sequence())
-      if (!std::filesystem::exists(
-            state.path / state.source_filenames.get_nth_filename(i), error))
+      if (!source_exists(
+            state.path / state.source_filenames.get_nth_filename(i)))
         break;
 
     if (m_settings.mode == Mode::autocomplete) {
@@ -482,7 +488,30 @@ void InputParser::sheet_ends(State& state) {
   sheet.border_padding = state.border_padding;
   sheet.shape_padding = state.shape_padding;
   sheet.duplicates = state.duplicates;
+  sheet.stable = state.stable;
+  sheet.max_fragmentation = state.max_fragmentation;
   sheet.pack = state.pack;
+
+  // sprites are placed at multiples of the bleed-free mipmap level's texel size
+  if (const auto alignment = get_mipmap_alignment(sheet); alignment > 1) {
+    if (sheet.pack == Pack::compact || sheet.pack == Pack::compact_physics ||
+        sheet.pack == Pack::keep)
+      error("pack method does not support bleed-free mipmaps");
+    sheet.border_padding = ceil(sheet.border_padding, alignment);
+
+    // keep the slice size a multiple of the alignment
+    sheet.width = ceil(sheet.width, alignment);
+    sheet.height = ceil(sheet.height, alignment);
+    sheet.max_width = floor(sheet.max_width, alignment);
+    sheet.max_height = floor(sheet.max_height, alignment);
+    if (sheet.divisible_width) {
+      sheet.divisible_width = std::lcm(sheet.divisible_width, alignment);
+      sheet.max_width = floor(sheet.max_width, sheet.divisible_width);
+    }
+    if ((state.max_width && !sheet.max_width) ||
+        (state.max_height && !sheet.max_height))
+      error("max size is smaller than bleed-free mipmap alignment");
+  }
 }
 
 void InputParser::output_ends(State& state) {
@@ -496,6 +525,15 @@ void InputParser::output_ends(State& state) {
   output->alpha_color = state.alpha_color;
   output->scale = state.scale;
   output->scale_filter = state.scale_filter;
+  output->compression = state.compression;
+  output->mipmaps = state.mipmaps;
+  output->mipmap_levels = state.mipmap_levels;
+  output->mipmap_bleed_free_level = state.mipmap_bleed_free_level;
+  if (output->mipmaps && output->mipmap_bleed_free_level &&
+      std::exp2(std::round(std::log2(output->scale))) != output->scale)
+    error("scale must be a power of two for bleed-free mipmaps");
+  output->array = state.array;
+  output->palette_colors = state.palette_colors;
   output->debug = state.debug;
 }
 
@@ -593,6 +631,7 @@ void InputParser::description_ends(State& state) {
   auto& description = m_descriptions.emplace_back();
   description.filename = state.description_filename;
   description.template_filename = state.template_filename;
+  description.format = state.description_format;
 }
 
 void InputParser::transform_begins(State& state, State& parent_state) {
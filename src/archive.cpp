@@ -0,0 +1,295 @@
+
+#include "archive.h"
+#include "miniz/miniz.h"
+#include <mutex>
+#include <cstdio>
+
+namespace spright {
+
+namespace {
+  // the whole archive is kept in memory, so members can be extracted in parallel
+  class ZipArchive {
+  public:
+    explicit ZipArchive(const std::filesystem::path& filename) {
+      if (!read_file(filename, m_data) ||
+          !mz_zip_reader_init_mem(&m_zip, m_data.data(), m_data.size(), 0))
+        error("reading archive '", path_to_utf8(filename), "' failed");
+
+      const auto count = mz_zip_reader_get_num_files(&m_zip);
+      for (auto i = mz_uint{ }; i < count; ++i) {
+        auto stat = mz_zip_archive_file_stat{ };
+        if (mz_zip_reader_is_file_a_directory(&m_zip, i) ||
+            !mz_zip_reader_file_stat(&m_zip, i, &stat))
+          continue;
+        m_members.emplace(stat.m_filename, Member{ i, to_size(stat.m_uncomp_size) });
+      }
+    }
+
+    ZipArchive(const ZipArchive&) = delete;
+    ZipArchive& operator=(const ZipArchive&) = delete;
+
+    ~ZipArchive() {
+      mz_zip_reader_end(&m_zip);
+    }
+
+    bool contains(std::string_view name) const {
+      return (m_members.find(name) != m_members.end());
+    }
+
+    bool read(std::string_view name, std::string& buffer) const {
+      const auto it = m_members.find(name);
+      if (it == m_members.end())
+        return false;
+      const auto& member = it->second;
+      buffer.resize(member.size);
+      return mz_zip_reader_extract_to_mem(&m_zip, member.index,
+        buffer.data(), buffer.size(), 0);
+    }
+
+    template<typename F>
+    void for_each_member(F&& func) const {
+      for (const auto& [name, member] : m_members)
+        func(name);
+    }
+
+  private:
+    struct Member {
+      mz_uint index;
+      size_t size;
+    };
+
+    static size_t to_size(mz_uint64 size) {
+      return static_cast<size_t>(size);
+    }
+
+    std::string m_data;
+    mutable mz_zip_archive m_zip{ };
+    std::map<std::string, Member, std::less<>> m_members;
+  };
+
+  // archives are opened once, unless they were modified
+  class ArchiveCache {
+  public:
+    std::shared_ptr<const ZipArchive> get(const std::filesystem::path& filename) {
+      auto lock = std::lock_guard(m_mutex);
+      auto error = std::error_code{ };
+      auto& entry = m_archives[std::filesystem::weakly_canonical(filename, error)];
+      const auto last_write_time = get_last_write_time(filename);
+      if (!entry.archive || entry.last_write_time != last_write_time) {
+        entry.archive = std::make_shared<ZipArchive>(filename);
+        entry.last_write_time = last_write_time;
+      }
+      return entry.archive;
+    }
+
+  private:
+    struct Entry {
+      std::shared_ptr<const ZipArchive> archive;
+      std::filesystem::file_time_type last_write_time;
+    };
+    std::mutex m_mutex;
+    std::map<std::filesystem::path, Entry> m_archives;
+  };
+
+  ArchiveCache g_archive_cache;
+
+  // ZIP archive, to which the parallel output workers add their files
+  class OutputBundle {
+  public:
+    ~OutputBundle() {
+      // discard unfinished archive
+      if (m_file) {
+        mz_zip_writer_end(&m_zip);
+        std::fclose(m_file);
+        auto error = std::error_code{ };
+        std::filesystem::remove(m_temp_filename, error);
+      }
+    }
+
+    void open(const std::filesystem::path& filename) {
+      check(!m_file, "output bundle already open");
+      auto error = std::error_code{ };
+      if (!filename.parent_path().empty())
+        std::filesystem::create_directories(filename.parent_path(), error);
+      m_filename = filename;
+      m_temp_filename = get_temporary_filename(filename);
+#if defined(_WIN32)
+      m_file = _wfopen(m_temp_filename.wstring().c_str(), L"wb");
+#else
+      m_file = std::fopen(path_to_utf8(m_temp_filename).c_str(), "wb");
+#endif
+      if (!m_file || !mz_zip_writer_init_cfile(&m_zip, m_file, 0)) {
+        if (m_file)
+          std::fclose(std::exchange(m_file, nullptr));
+        spright::error("writing file '", path_to_utf8(filename), "' failed");
+      }
+    }
+
+    bool is_open() const {
+      return (m_file != nullptr);
+    }
+
+    void add(const std::filesystem::path& filename, std::string_view data) {
+      const auto name = get_entry_name(filename);
+
+      // compress in the calling thread, already compressed formats are stored
+      const auto extension = to_lower(path_to_utf8(filename.extension()));
+      auto compressed = std::unique_ptr<void, decltype(&mz_free)>(nullptr, &mz_free);
+      auto compressed_size = size_t{ };
+      if (extension != ".png" && extension != ".gif" && !data.empty())
+        compressed.reset(tdefl_compress_mem_to_heap(data.data(), data.size(),
+          &compressed_size, static_cast<int>(tdefl_create_comp_flags_from_zip_params(
+            MZ_DEFAULT_LEVEL, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY))));
+      const auto crc = static_cast<mz_uint32>(mz_crc32(MZ_CRC32_INIT, 
+        reinterpret_cast<const mz_uint8*>(data.data()), data.size()));
+
+      auto lock = std::lock_guard(m_mutex);
+      const auto result = (compressed ?
+        mz_zip_writer_add_mem_ex(&m_zip, name.c_str(),
+          compressed.get(), compressed_size, nullptr, 0, 
+          static_cast<mz_uint>(MZ_DEFAULT_LEVEL) | MZ_ZIP_FLAG_COMPRESSED_DATA,
+          data.size(), crc) :
+        mz_zip_writer_add_mem(&m_zip, name.c_str(),
+          data.data(), data.size(), MZ_NO_COMPRESSION));
+      if (!result)
+        error("writing file '", path_to_utf8(filename), "' to bundle failed");
+    }
+
+    void close() {
+      if (!m_file)
+        return;
+      const auto result = mz_zip_writer_finalize_archive(&m_zip);
+      mz_zip_writer_end(&m_zip);
+      std::fclose(std::exchange(m_file, nullptr));
+      auto error = std::error_code{ };
+      if (result)
+        std::filesystem::rename(m_temp_filename, m_filename, error);
+      if (!result || error) {
+        std::filesystem::remove(m_temp_filename, error);
+        spright::error("writing file '", path_to_utf8(m_filename), "' failed");
+      }
+    }
+
+  private:
+    // relative to the bundle's directory, leading '..' are removed,
+    // so entries can not be extracted outside of it
+    std::string get_entry_name(const std::filesystem::path& filename) const {
+      const auto absolute = [](const std::filesystem::path& path) {
+        auto error = std::error_code{ };
+        return std::filesystem::absolute(path, error).lexically_normal();
+      };
+      auto relative = absolute(filename).lexically_relative(
+        absolute(m_filename).parent_path());
+      if (relative.empty())
+        relative = absolute(filename).relative_path();
+
+      auto name = std::string();
+      for (const auto& part : relative) {
+        if (part == ".." || part == "." || part.empty())
+          continue;
+        if (!name.empty())
+          name.push_back('/');
+        name += path_to_utf8(part);
+      }
+      if (name.empty())
+        error("writing file '", path_to_utf8(filename), "' to bundle failed");
+      return name;
+    }
+
+    std::filesystem::path m_filename;
+    std::filesystem::path m_temp_filename;
+    std::FILE* m_file{ };
+    mz_zip_archive m_zip{ };
+    std::mutex m_mutex;
+  };
+
+  OutputBundle g_output_bundle;
+
+  bool is_archive(const std::filesystem::path& path) {
+    auto error = std::error_code{ };
+    return (to_lower(path_to_utf8(path.extension())) == ".zip" &&
+      std::filesystem::is_regular_file(path, error));
+  }
+} // namespace
+
+std::optional<std::pair<std::filesystem::path, std::string>> 
+    split_archive_path(const std::filesystem::path& path) {
+  auto archive = std::filesystem::path();
+  for (auto it = path.begin(); it != path.end(); ++it) {
+    archive /= *it;
+    if (is_archive(archive)) {
+      auto member = std::filesystem::path();
+      for (++it; it != path.end(); ++it)
+        member /= *it;
+      return std::make_pair(archive, path_to_utf8(member));
+    }
+  }
+  return std::nullopt;
+}
+
+std::filesystem::path get_containing_file(const std::filesystem::path& path) {
+  if (auto archive_path = split_archive_path(path))
+    return archive_path->first;
+  return path;
+}
+
+bool source_exists(const std::filesystem::path& path) {
+  if (auto archive_path = split_archive_path(path)) {
+    const auto& [archive, member] = *archive_path;
+    return g_archive_cache.get(archive)->contains(member);
+  }
+  auto error = std::error_code{ };
+  return std::filesystem::exists(path, error);
+}
+
+bool read_source_file(const std::filesystem::path& path, std::string& buffer) {
+  if (auto archive_path = split_archive_path(path)) {
+    const auto& [archive, member] = *archive_path;
+    return g_archive_cache.get(archive)->read(member, buffer);
+  }
+  return read_file(path, buffer);
+}
+
+bool for_each_archive_file(const std::filesystem::path& directory, bool recursive,
+    const std::function<void(const std::filesystem::path&)>& func) {
+  const auto archive_path = split_archive_path(directory);
+  if (!archive_path)
+    return false;
+
+  const auto& [archive, member] = *archive_path;
+  auto prefix = member;
+  if (!prefix.empty() && prefix.back() != '/')
+    prefix.push_back('/');
+
+  g_archive_cache.get(archive)->for_each_member(
+    [&](const std::string& name) {
+      if (!starts_with(name, prefix))
+        return;
+      const auto filename = std::string_view(name).substr(prefix.size());
+      if (!recursive && filename.find('/') != std::string::npos)
+        return;
+      func(directory / utf8_to_path(filename));
+    });
+  return true;
+}
+
+void open_output_bundle(const std::filesystem::path& filename) {
+  g_output_bundle.open(filename);
+}
+
+void close_output_bundle() {
+  g_output_bundle.close();
+}
+
+bool is_output_bundle_open() {
+  return g_output_bundle.is_open();
+}
+
+bool add_to_output_bundle(const std::filesystem::path& filename, std::string_view data) {
+  if (!g_output_bundle.is_open())
+    return false;
+  g_output_bundle.add(filename, data);
+  return true;
+}
+
+} // namespace
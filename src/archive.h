@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+#include <functional>
+
+namespace spright {
+
+// paths can lead into ZIP archives, e.g. "sprites.zip/hero/walk-0.png"
+
+// splits a path into the archive and the member within, when it leads into an archive
+std::optional<std::pair<std::filesystem::path, std::string>> 
+  split_archive_path(const std::filesystem::path& path);
+
+// returns the archive a path leads into or the path itself
+std::filesystem::path get_containing_file(const std::filesystem::path& path);
+
+bool source_exists(const std::filesystem::path& path);
+bool read_source_file(const std::filesystem::path& path, std::string& buffer);
+
+// calls func for each file in a directory of an archive,
+// returns false when the directory does not lead into an archive
+bool for_each_archive_file(const std::filesystem::path& directory, bool recursive,
+  const std::function<void(const std::filesystem::path&)>& func);
+
+// while an output bundle is open, output files are added to it instead
+void open_output_bundle(const std::filesystem::path& filename);
+void close_output_bundle();
+bool is_output_bundle_open();
+// returns false, when no output bundle is open
+bool add_to_output_bundle(const std::filesystem::path& filename, std::string_view data);
+
+} // namespace
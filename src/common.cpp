@@ -3,8 +3,12 @@
 #include <cstring>
 #include <charconv>
 #include <algorithm>
+#include <array>
 #include <fstream>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <random>
 #include "cpp-base64/base64.h"
 
 Scheduler scheduler;
@@ -59,6 +63,38 @@ namespace {
   };
 
   WarningDeduplicator g_warning_deduplicator;
+
+  // compares size first and then the content chunk by chunk
+  bool file_content_equals(const std::filesystem::path& filename, 
+      std::string_view text) {
+    auto error = std::error_code{ };
+    const auto size = std::filesystem::file_size(filename, error);
+    if (error || size != text.size())
+      return false;
+
+    auto file = std::ifstream(filename, std::ios::in | std::ios::binary);
+    auto buffer = std::array<char, 16384>();
+    for (auto offset = size_t{ }; offset < text.size(); ) {
+      const auto count = std::min(buffer.size(), text.size() - offset);
+      if (!file.read(buffer.data(), static_cast<std::streamsize>(count)) ||
+          std::memcmp(buffer.data(), text.data() + offset, count) != 0)
+        return false;
+      offset += count;
+    }
+    return true;
+  }
+
+  // writes to a temporary file, which then replaces the file
+  void replace_textfile(const std::filesystem::path& filename, std::string_view text) {
+    const auto temp_filename = get_temporary_filename(filename);
+    write_textfile(temp_filename, text);
+    auto error = std::error_code{ };
+    std::filesystem::rename(temp_filename, filename, error);
+    if (error) {
+      std::filesystem::remove(temp_filename, error);
+      throw std::runtime_error("writing file '" + path_to_utf8(filename) + "' failed");
+    }
+  }
 } // namespace
 
 void warning(std::string_view message, int line_number) {
@@ -352,11 +388,24 @@ void split_expression(std::string_view str, std::vector<std::string_view>* resul
   }
 }
 
-std::string read_textfile(const std::filesystem::path& filename) {
-  auto file = std::ifstream(filename, std::ios::in | std::ios::binary);
+bool read_file(const std::filesystem::path& filename, std::string& buffer) {
+  auto file = std::ifstream(filename, std::ios::in | std::ios::binary | std::ios::ate);
   if (!file.good())
+    return false;
+  const auto size = static_cast<std::streamsize>(file.tellg());
+  if (size < 0)
+    return false;
+  // read at once, the buffer's capacity is kept
+  buffer.resize(static_cast<size_t>(size));
+  file.seekg(0);
+  return static_cast<bool>(file.read(buffer.data(), size));
+}
+
+std::string read_textfile(const std::filesystem::path& filename) {
+  auto text = std::string();
+  if (!read_file(filename, text))
     throw std::runtime_error("reading file '" + path_to_utf8(filename) + "' failed");
-  return std::string(std::istreambuf_iterator<char>{ file }, { });
+  return text;
 }
 
 std::string base64_encode_file(const std::filesystem::path& filename) {
@@ -372,12 +421,22 @@ void write_textfile(const std::filesystem::path& filename, std::string_view text
   file.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
 
+std::filesystem::path get_temporary_filename(const std::filesystem::path& filename) {
+  // unique per process and call, so concurrent writers never share a file
+  static const auto process_key = std::random_device()() ^ static_cast<unsigned int>(
+    std::chrono::steady_clock::now().time_since_epoch().count());
+  static auto counter = std::atomic<unsigned int>();
+  auto ss = std::ostringstream();
+  ss << '.' << process_key << '-' << counter++ << ".tmp";
+  auto temp_filename = filename;
+  temp_filename += ss.str();
+  return temp_filename;
+}
+
 bool update_textfile(const std::filesystem::path& filename, std::string_view text) {
-  auto error = std::error_code{ };
-  if (std::filesystem::exists(filename, error))
-    if (const auto current = read_textfile(filename); current == text)
-      return false;
-  write_textfile(filename, text);
+  if (file_content_equals(filename, text))
+    return false;
+  replace_textfile(filename, text);
   return true;
 }
 
@@ -409,7 +468,7 @@ std::string remove_directory(std::string filename, int keep_n) {
 
 bool has_supported_extension(std::string_view filename) {
   const auto ext = get_extension(filename);
-  for (const auto supported : { ".png", ".gif", ".bmp", ".tga" })
+  for (const auto supported : { ".png", ".gif", ".bmp", ".tga", ".qoi" })
     if (equal_case_insensitive(ext, supported))
       return true;
   return false;
@@ -487,4 +546,21 @@ std::string make_identifier(std::string string) {
   return string;
 }
 
+void Hasher::add(const void* data, size_t size) {
+  const auto mix = [&](uint64_t word) {
+    m_hash = (m_hash ^ word) * 0x9E3779B97F4A7C15ull;
+    m_hash ^= (m_hash >> 32);
+  };
+  // process 8 bytes at a time
+  auto bytes = static_cast<const char*>(data);
+  for (; size >= 8; bytes += 8, size -= 8) {
+    auto word = uint64_t{ };
+    std::memcpy(&word, bytes, 8);
+    mix(word);
+  }
+  auto word = uint64_t{ };
+  std::memcpy(&word, bytes, size);
+  mix(word ^ (static_cast<uint64_t>(size) << 56));
+}
+
 } // namespace
@@ -14,6 +14,7 @@
 #include <cassert>
 #include <variant>
 #include <map>
+#include <cstdint>
 
 #if __cplusplus > 201703L && __has_include(<span>)
 # include <span>
@@ -109,10 +110,12 @@ void split_arguments(LStringView str, std::vector<std::string_view>* result);
 std::pair<std::string_view, int> split_name_number(LStringView str);
 void join_expressions(std::vector<std::string_view>* arguments);
 void split_expression(std::string_view str, std::vector<std::string_view>* result);
+bool read_file(const std::filesystem::path& filename, std::string& buffer);
 std::string read_textfile(const std::filesystem::path& filename);
 std::string base64_encode_file(const std::filesystem::path& filename);
 void write_textfile(const std::filesystem::path& filename, std::string_view text);
 bool update_textfile(const std::filesystem::path& filename, std::string_view text);
+std::filesystem::path get_temporary_filename(const std::filesystem::path& filename);
 std::string_view get_extension(LStringView filename);
 std::string remove_extension(std::string filename);
 std::string remove_directory(std::string filename, int keep_n = 0);
@@ -124,6 +127,28 @@ void replace_variables(std::filesystem::path& path, const VariantMap& variables)
 std::string variant_to_string(const Variant& variant);
 std::string make_identifier(std::string string);
 
+// non-cryptographic hash for detecting changed content
+class Hasher {
+public:
+  void add(const void* data, size_t size);
+
+  template<typename T>
+  void add_value(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    add(&value, sizeof(T));
+  }
+
+  void add_string(std::string_view string) {
+    add_value(string.size());
+    add(string.data(), string.size());
+  }
+
+  uint64_t value() const { return m_hash; }
+
+private:
+  uint64_t m_hash{ 0xCBF29CE484222325ull };
+};
+
 constexpr real deg_to_rad(real deg) { return deg * (pi / 180.0); }
 constexpr int floor(int v, int q) { return (v / q) * q; };
 constexpr int ceil(int v, int q) { return ((v + q - 1) / q) * q; };
@@ -2,6 +2,7 @@
 #include "globbing.h"
 #include "FilenameSequence.h"
 #include "common.h"
+#include "archive.h"
 
 namespace spright {
 
@@ -52,6 +53,9 @@ namespace {
 
   template<typename F>
   void for_each_file(const std::filesystem::path& path, bool recursive, F&& func) {
+    if (for_each_archive_file(path, recursive, func))
+      return;
+
     const auto options =
       std::filesystem::directory_options::follow_directory_symlink |
       std::filesystem::directory_options::skip_permission_denied;
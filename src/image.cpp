@@ -138,17 +138,6 @@ namespace {
   }
 
   // http://paulbourke.net/geometry/polygonmesh/
-  bool point_in_polygon(real x, real y, const std::vector<PointF>& p) {
-    auto c = false;
-    for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++) {
-      if ((((p[i].y <= y) && (y < p[j].y)) ||
-           ((p[j].y <= y) && (y < p[i].y))) &&
-          (x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x))
-        c = !c;
-    }
-    return c;
-  }
-
   RGBAF blend(const RGBAF& a, const RGBAF& b, float mix) {
     const auto blend = [](auto a, auto b, auto mix) {
       return a + (b - a) * mix;
@@ -286,6 +275,17 @@ void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& d
         sizeof(RGBA));
 }
 
+bool point_in_polygon(real x, real y, const std::vector<PointF>& p) {
+  auto c = false;
+  for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++) {
+    if ((((p[i].y <= y) && (y < p[j].y)) ||
+         ((p[j].y <= y) && (y < p[i].y))) &&
+        (x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x))
+      c = !c;
+  }
+  return c;
+}
+
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy,
     const std::vector<PointF>& mask_vertices) {
   const auto source_rgba = source.view<RGBA>();
@@ -577,15 +577,21 @@ Image get_gray_levels(const Image& image, const Rect& rect) {
 }
 
 Image resize_image(const Image& image, real scale, ResizeFilter filter) {
-  const auto width = to_int(image.width() * scale + 0.5);
-  const auto height = to_int(image.height() * scale + 0.5);
-  if (width == image.width() && height == image.height())
-    return clone_image(image);
-
   if (filter == ResizeFilter::undefined &&
       std::fmod(scale, 1.0f) == 0)
     filter = ResizeFilter::box;
 
+  return resize_image(image, {
+    to_int(image.width() * scale + 0.5),
+    to_int(image.height() * scale + 0.5)
+  }, filter);
+}
+
+Image resize_image(const Image& image, const Size& size, ResizeFilter filter) {
+  const auto [width, height] = size;
+  if (width == image.width() && height == image.height())
+    return clone_image(image);
+
   auto output = Image(image.type(), width, height);
   auto data_type = stbir_datatype{ };
   auto pixel_layout = stbir_pixel_layout{ };
@@ -613,6 +619,24 @@ Image resize_image(const Image& image, real scale, ResizeFilter filter) {
   return output;
 }
 
+std::vector<Image> generate_mipmaps(const Image& image, int levels, ResizeFilter filter) {
+  if (filter == ResizeFilter::undefined)
+    filter = ResizeFilter::box;
+
+  // each level is generated from the previous one, until 1x1 is reached
+  auto mipmaps = std::vector<Image>();
+  for (auto level = 1; levels <= 0 || level < levels; ++level) {
+    const auto& previous = (mipmaps.empty() ? image : mipmaps.back());
+    if (previous.width() == 1 && previous.height() == 1)
+      break;
+    mipmaps.push_back(resize_image(previous, {
+      std::max(previous.width() / 2, 1),
+      std::max(previous.height() / 2, 1)
+    }, filter));
+  }
+  return mipmaps;
+}
+
 Image convert_to_linear(const Image& image, const Rect& rect) {
   if (empty(rect))
     return convert_to_linear(image, image.bounds());
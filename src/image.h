@@ -133,6 +133,16 @@ enum class RotateMethod {
   bilinear,
 };
 
+enum class Compression {
+  undefined,
+  none,
+  bc1,          // RGB with 1-bit alpha, 4 bits per pixel
+  bc3,          // RGBA, 8 bits per pixel
+  bc7,          // RGBA with higher quality, 8 bits per pixel
+  etc2,         // RGB, 4 bits per pixel
+  etc2a,        // RGBA with EAC alpha block, 8 bits per pixel
+};
+
 struct Animation {
   struct Frame {
     int index;
@@ -176,10 +186,24 @@ void check_rect(const ImageOrView& image, const Rect& rect) {
 }
 
 // io
+Image decode_image(std::string_view data);
 Image load_image(const std::filesystem::path& filename);
-void save_image(const Image& image, const std::filesystem::path& filename);
+// uses a cache of decoded images, when a cache path is set
+Image load_image(const std::filesystem::path& filename,
+  const std::filesystem::path& cache_path);
+void save_image(const Image& image, const std::filesystem::path& filename,
+  Compression compression = Compression::undefined,
+  const std::vector<Image>& mipmaps = { }, int max_colors = 0);
+void save_image_array(const std::vector<Image>& layers,
+  const std::filesystem::path& filename,
+  Compression compression = Compression::undefined,
+  const std::vector<std::vector<Image>>& layer_mipmaps = { });
 void save_animation(const Animation& animation, const std::filesystem::path& filename);
 
+// compress
+size_t get_compressed_block_size(Compression compression);
+std::vector<std::byte> compress_image(const Image& image, Compression compression);
+
 // draw
 void draw_rect(Image& image, const Rect& rect, const RGBA& color);
 void draw_line(Image& image, const Point& p0, const Point& p1, 
@@ -191,8 +215,11 @@ void fill_rect(Image& image, const Rect& rect, const RGBA& color);
 
 Image clone_image(const Image& image, const Rect& rect = { }, int padding = 0);
 Image resize_image(const Image& image, real scale, ResizeFilter filter);
+Image resize_image(const Image& image, const Size& size, ResizeFilter filter);
+std::vector<Image> generate_mipmaps(const Image& image, int levels, ResizeFilter filter);
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy);
 void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy);
+bool point_in_polygon(real x, real y, const std::vector<PointF>& polygon);
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, 
   int dx, int dy, const std::vector<PointF>& mask_vertices);
 void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& dest, 
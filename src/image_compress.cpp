@@ -0,0 +1,561 @@
+
+#include "image.h"
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+namespace spright {
+
+namespace {
+  using Block = std::array<RGBA, 16>;
+  using Vec4 = std::array<float, 4>;
+  using BlockMask = std::array<bool, 16>;
+
+  Block get_block(ImageView<const RGBA> image_rgba, int block_x, int block_y) {
+    // clamp to edge for images which are not divisible by the block size
+    auto block = Block{ };
+    for (auto y = 0; y < 4; ++y)
+      for (auto x = 0; x < 4; ++x)
+        block[to_unsigned(y * 4 + x)] = image_rgba.value_at({
+          std::min(block_x * 4 + x, image_rgba.width() - 1),
+          std::min(block_y * 4 + y, image_rgba.height() - 1)
+        });
+    return block;
+  }
+
+  Vec4 to_vec4(const RGBA& color) {
+    return { static_cast<float>(color.r), static_cast<float>(color.g),
+             static_cast<float>(color.b), static_cast<float>(color.a) };
+  }
+
+  int squared_distance(const RGBA& a, const RGBA& b, int channels) {
+    auto distance = 0;
+    for (auto i = 0; i < channels; ++i) {
+      const auto d = a.channel(i) - b.channel(i);
+      distance += d * d;
+    }
+    return distance;
+  }
+
+  // returns the extremes of the masked colors projected on their principal axis
+  std::pair<Vec4, Vec4> fit_endpoints(const Block& block,
+      const BlockMask& mask, int channels) {
+    auto mean = Vec4{ };
+    auto count = 0;
+    for (auto i = 0u; i < 16; ++i)
+      if (mask[i]) {
+        const auto color = to_vec4(block[i]);
+        for (auto c = 0; c < channels; ++c)
+          mean[to_unsigned(c)] += color[to_unsigned(c)];
+        ++count;
+      }
+    for (auto& m : mean)
+      m /= static_cast<float>(std::max(count, 1));
+
+    auto covariance = std::array<Vec4, 4>{ };
+    for (auto i = 0u; i < 16; ++i)
+      if (mask[i]) {
+        const auto color = to_vec4(block[i]);
+        for (auto r = 0u; r < to_unsigned(channels); ++r)
+          for (auto c = 0u; c < to_unsigned(channels); ++c)
+            covariance[r][c] += (color[r] - mean[r]) * (color[c] - mean[c]);
+      }
+
+    // power iteration
+    auto axis = Vec4{ 1, 1, 1, 1 };
+    for (auto iteration = 0; iteration < 8; ++iteration) {
+      auto next = Vec4{ };
+      auto max = 0.0f;
+      for (auto r = 0u; r < to_unsigned(channels); ++r) {
+        for (auto c = 0u; c < to_unsigned(channels); ++c)
+          next[r] += covariance[r][c] * axis[c];
+        max = std::max(max, std::fabs(next[r]));
+      }
+      if (max == 0.0f)
+        break;
+      for (auto& n : next)
+        n /= max;
+      axis = next;
+    }
+
+    auto min_t = std::numeric_limits<float>::max();
+    auto max_t = std::numeric_limits<float>::lowest();
+    for (auto i = 0u; i < 16; ++i)
+      if (mask[i]) {
+        const auto color = to_vec4(block[i]);
+        auto t = 0.0f;
+        for (auto c = 0u; c < to_unsigned(channels); ++c)
+          t += (color[c] - mean[c]) * axis[c];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+      }
+
+    auto length = 0.0f;
+    for (auto c = 0u; c < to_unsigned(channels); ++c)
+      length += axis[c] * axis[c];
+    if (count == 0 || length == 0.0f)
+      return { mean, mean };
+
+    auto e0 = Vec4{ };
+    auto e1 = Vec4{ };
+    for (auto c = 0u; c < to_unsigned(channels); ++c) {
+      e0[c] = std::clamp(mean[c] + axis[c] * min_t / length, 0.0f, 255.0f);
+      e1[c] = std::clamp(mean[c] + axis[c] * max_t / length, 0.0f, 255.0f);
+    }
+    return { e0, e1 };
+  }
+
+  class BitWriter {
+  public:
+    explicit BitWriter(std::byte* output) : m_output(output) { }
+
+    void write(uint32_t value, int bits) {
+      for (auto i = 0; i < bits; ++i, ++m_position)
+        if ((value >> i) & 1)
+          m_output[m_position / 8] |= std::byte{ 1 } << (m_position % 8);
+    }
+
+  private:
+    std::byte* m_output;
+    size_t m_position{ };
+  };
+
+  void write_le(std::byte* output, uint64_t value, int bytes) {
+    for (auto i = 0; i < bytes; ++i)
+      output[i] = static_cast<std::byte>((value >> (8 * i)) & 0xFF);
+  }
+
+  uint16_t to_rgb565(const Vec4& color) {
+    const auto quantize = [](float value, int max) {
+      return static_cast<uint16_t>(std::clamp(
+        static_cast<int>(value * static_cast<float>(max) / 255.0f + 0.5f), 0, max));
+    };
+    return static_cast<uint16_t>(quantize(color[0], 31) << 11 |
+      quantize(color[1], 63) << 5 | quantize(color[2], 31));
+  }
+
+  RGBA from_rgb565(uint16_t value) {
+    const auto r = (value >> 11) & 0x1F;
+    const auto g = (value >> 5) & 0x3F;
+    const auto b = value & 0x1F;
+    return {
+      RGBA::to_channel(r << 3 | r >> 2),
+      RGBA::to_channel(g << 2 | g >> 4),
+      RGBA::to_channel(b << 3 | b >> 2),
+      255
+    };
+  }
+
+  RGBA interpolate(const RGBA& a, const RGBA& b, int wa, int wb) {
+    const auto mix = [&](int c) {
+      return RGBA::to_channel((a.channel(c) * wa + b.channel(c) * wb) / (wa + wb));
+    };
+    return { mix(0), mix(1), mix(2), 255 };
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression#bc1
+  void encode_bc1(const Block& block, bool punchthrough_alpha, std::byte* output) {
+    auto transparent = BlockMask{ };
+    auto mask = BlockMask{ };
+    auto any_visible = false;
+    auto any_transparent = false;
+    for (auto i = 0u; i < 16; ++i) {
+      transparent[i] = (punchthrough_alpha ?
+        block[i].a < 128 : false);
+      // invisible colors should not influence the endpoints
+      mask[i] = (punchthrough_alpha ? !transparent[i] : block[i].a > 0);
+      any_visible |= mask[i];
+      any_transparent |= transparent[i];
+    }
+    if (!any_visible && !punchthrough_alpha)
+      mask.fill(true);
+
+    const auto [e0, e1] = fit_endpoints(block, mask, 3);
+    auto c0 = to_rgb565(e1);
+    auto c1 = to_rgb565(e0);
+    // four color mode requires c0 > c1, three color mode c0 <= c1
+    if (any_transparent ? c0 > c1 : c0 < c1)
+      std::swap(c0, c1);
+
+    auto palette = std::array<RGBA, 4>{ from_rgb565(c0), from_rgb565(c1) };
+    const auto four_colors = (c0 > c1);
+    if (four_colors) {
+      palette[2] = interpolate(palette[0], palette[1], 2, 1);
+      palette[3] = interpolate(palette[0], palette[1], 1, 2);
+    }
+    else {
+      palette[2] = interpolate(palette[0], palette[1], 1, 1);
+    }
+
+    auto indices = uint32_t{ };
+    for (auto i = 0u; i < 16; ++i) {
+      auto index = 3u;
+      if (!transparent[i]) {
+        auto min_distance = std::numeric_limits<int>::max();
+        for (auto p = 0u; p < (four_colors ? 4u : 3u); ++p)
+          if (const auto distance = squared_distance(block[i], palette[p], 3);
+              distance < min_distance) {
+            min_distance = distance;
+            index = p;
+          }
+      }
+      indices |= index << (2 * i);
+    }
+    write_le(output, c0, 2);
+    write_le(output + 2, c1, 2);
+    write_le(output + 4, indices, 4);
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression#bc4
+  void encode_bc4_alpha(const Block& block, std::byte* output) {
+    auto a0 = 0;
+    auto a1 = 255;
+    for (const auto& color : block) {
+      a0 = std::max(a0, int{ color.a });
+      a1 = std::min(a1, int{ color.a });
+    }
+    auto palette = std::array<int, 8>{ a0, a1 };
+    for (auto i = 1; i < 7; ++i)
+      palette[to_unsigned(i + 1)] = ((7 - i) * a0 + i * a1) / 7;
+
+    auto indices = uint64_t{ };
+    if (a0 != a1)
+      for (auto i = 0u; i < 16; ++i) {
+        auto index = 0u;
+        auto min_distance = std::numeric_limits<int>::max();
+        for (auto p = 0u; p < 8; ++p)
+          if (const auto distance = std::abs(block[i].a - palette[p]);
+              distance < min_distance) {
+            min_distance = distance;
+            index = p;
+          }
+        indices |= uint64_t{ index } << (3 * i);
+      }
+    write_le(output, to_unsigned(a0), 1);
+    write_le(output + 1, to_unsigned(a1), 1);
+    write_le(output + 2, indices, 6);
+  }
+
+  void encode_bc3(const Block& block, std::byte* output) {
+    encode_bc4_alpha(block, output);
+    encode_bc1(block, false, output + 8);
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3d11/bc7-format-mode-reference#mode-6
+  void encode_bc7_mode6(const Block& block, std::byte* output) {
+    constexpr auto weights = std::array<int, 16>{
+      0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    auto mask = BlockMask{ };
+    mask.fill(true);
+    const auto [e0, e1] = fit_endpoints(block, mask, 4);
+
+    // quantize endpoint to 7 bits per channel and a shared p-bit
+    struct Endpoint { std::array<uint32_t, 4> values; uint32_t p; };
+    const auto quantize = [](const Vec4& color) {
+      auto best = Endpoint{ };
+      auto best_error = std::numeric_limits<float>::max();
+      for (auto p = 0u; p < 2; ++p) {
+        auto endpoint = Endpoint{ { }, p };
+        auto error = 0.0f;
+        for (auto c = 0u; c < 4; ++c) {
+          const auto value = std::clamp(static_cast<int>(
+            (color[c] - static_cast<float>(p)) / 2.0f + 0.5f), 0, 127);
+          endpoint.values[c] = to_unsigned(value);
+          const auto d = static_cast<float>(value * 2) + static_cast<float>(p) - color[c];
+          error += d * d;
+        }
+        if (error < best_error) {
+          best_error = error;
+          best = endpoint;
+        }
+      }
+      return best;
+    };
+    auto q0 = quantize(e0);
+    auto q1 = quantize(e1);
+
+    const auto decode = [](const Endpoint& endpoint) {
+      auto color = RGBA{ };
+      for (auto c = 0; c < 4; ++c)
+        color.channel(c) = RGBA::to_channel(
+          endpoint.values[to_unsigned(c)] << 1 | endpoint.p);
+      return color;
+    };
+    const auto c0 = decode(q0);
+    const auto c1 = decode(q1);
+    auto palette = std::array<RGBA, 16>{ };
+    for (auto i = 0u; i < 16; ++i)
+      for (auto c = 0; c < 4; ++c)
+        palette[i].channel(c) = RGBA::to_channel(
+          ((64 - weights[i]) * c0.channel(c) + weights[i] * c1.channel(c) + 32) >> 6);
+
+    auto indices = std::array<uint32_t, 16>{ };
+    for (auto i = 0u; i < 16; ++i) {
+      auto min_distance = std::numeric_limits<int>::max();
+      for (auto p = 0u; p < 16; ++p)
+        if (const auto distance = squared_distance(block[i], palette[p], 4);
+            distance < min_distance) {
+          min_distance = distance;
+          indices[i] = p;
+        }
+    }
+
+    // most significant bit of anchor index is implicitly zero
+    if (indices[0] & 0x08) {
+      std::swap(q0, q1);
+      for (auto& index : indices)
+        index = 15 - index;
+    }
+
+    auto writer = BitWriter(output);
+    writer.write(1 << 6, 7);
+    for (auto c = 0u; c < 4; ++c) {
+      writer.write(q0.values[c], 7);
+      writer.write(q1.values[c], 7);
+    }
+    writer.write(q0.p, 1);
+    writer.write(q1.p, 1);
+    writer.write(indices[0], 3);
+    for (auto i = 1u; i < 16; ++i)
+      writer.write(indices[i], 4);
+  }
+
+  void write_be(std::byte* output, uint64_t value, int bytes) {
+    for (auto i = 0; i < bytes; ++i)
+      output[i] = static_cast<std::byte>((value >> (8 * (bytes - 1 - i))) & 0xFF);
+  }
+
+  // pixels of ETC blocks are indexed column by column
+  unsigned int get_etc_pixel_index(int x, int y) {
+    return to_unsigned(x * 4 + y);
+  }
+
+  constexpr auto etc_modifiers = std::array<std::array<int, 2>, 8>{ {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+  } };
+
+  struct EtcSubblock {
+    uint32_t table;
+    uint64_t selectors;
+    int error;
+  };
+
+  EtcSubblock encode_etc_subblock(const Block& block, bool flip, int subblock,
+      const RGBA& base) {
+    auto best = EtcSubblock{ 0, 0, std::numeric_limits<int>::max() };
+    for (auto table = 0u; table < 8; ++table) {
+      auto candidate = EtcSubblock{ table, 0, 0 };
+      for (auto y = 0; y < 4; ++y)
+        for (auto x = 0; x < 4; ++x) {
+          if ((flip ? y : x) / 2 != subblock)
+            continue;
+          // selectors 0, 1, 2, 3 add the small, large, negative small, negative large modifier
+          auto selector = 0u;
+          auto min_distance = std::numeric_limits<int>::max();
+          for (auto s = 0u; s < 4; ++s) {
+            const auto modifier = etc_modifiers[table][s & 1] * (s & 2 ? -1 : 1);
+            auto color = RGBA{ };
+            for (auto c = 0; c < 3; ++c)
+              color.channel(c) = RGBA::to_channel(
+                std::clamp(base.channel(c) + modifier, 0, 255));
+            if (const auto distance = squared_distance(
+                  block[to_unsigned(y * 4 + x)], color, 3);
+                distance < min_distance) {
+              min_distance = distance;
+              selector = s;
+            }
+          }
+          const auto pixel = get_etc_pixel_index(x, y);
+          candidate.error += min_distance;
+          candidate.selectors |= uint64_t{ selector >> 1 } << (16 + pixel) |
+                                 uint64_t{ selector & 1 } << pixel;
+        }
+      if (candidate.error < best.error)
+        best = candidate;
+    }
+    return best;
+  }
+
+  // https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html#ETC2
+  // only the ETC1 compatible individual and differential modes are used
+  void encode_etc2_rgb(const Block& block, std::byte* output) {
+    auto best = uint64_t{ };
+    auto best_error = std::numeric_limits<int>::max();
+    for (auto flip : { false, true }) {
+      auto means = std::array<Vec4, 2>{ };
+      for (auto y = 0; y < 4; ++y)
+        for (auto x = 0; x < 4; ++x)
+          for (auto c = 0; c < 3; ++c)
+            means[to_unsigned((flip ? y : x) / 2)][to_unsigned(c)] +=
+              static_cast<float>(block[to_unsigned(y * 4 + x)].channel(c)) / 8.0f;
+
+      for (auto differential : { true, false }) {
+        const auto max = (differential ? 31 : 15);
+        auto codes = std::array<std::array<int, 3>, 2>{ };
+        for (auto s = 0u; s < 2; ++s)
+          for (auto c = 0u; c < 3; ++c)
+            codes[s][c] = std::clamp(static_cast<int>(
+              means[s][c] * static_cast<float>(max) / 255.0f + 0.5f), 0, max);
+
+        // differences outside the 3 bit range select the other ETC2 modes
+        if (differential && std::any_of(codes[0].begin(), codes[0].end(), 
+            [&, c = 0u](int code) mutable {
+              const auto difference = codes[1][c++] - code;
+              return (difference < -4 || difference > 3);
+            }))
+          continue;
+
+        auto data = uint64_t{ };
+        auto error = 0;
+        for (auto s = 0u; s < 2; ++s) {
+          auto base = RGBA{ };
+          for (auto c = 0u; c < 3; ++c) {
+            const auto code = codes[s][c];
+            base.channel(static_cast<int>(c)) = RGBA::to_channel(differential ?
+              code << 3 | code >> 2 : code << 4 | code);
+          }
+          const auto subblock = encode_etc_subblock(block, flip, static_cast<int>(s), base);
+          error += subblock.error;
+          data |= subblock.selectors;
+          data |= uint64_t{ subblock.table } << (s ? 34 : 37);
+        }
+        for (auto c = 0u; c < 3; ++c) {
+          const auto shift = 56 - 8 * c;
+          if (differential) {
+            data |= uint64_t{ to_unsigned(codes[0][c]) } << (shift + 3);
+            data |= uint64_t{ to_unsigned(codes[1][c] - codes[0][c]) & 0x7 } << shift;
+          }
+          else {
+            data |= uint64_t{ to_unsigned(codes[0][c]) } << (shift + 4);
+            data |= uint64_t{ to_unsigned(codes[1][c]) } << shift;
+          }
+        }
+        data |= uint64_t{ differential } << 33 | uint64_t{ flip } << 32;
+        if (error < best_error) {
+          best_error = error;
+          best = data;
+        }
+      }
+    }
+    write_be(output, best, 8);
+  }
+
+  constexpr auto eac_modifiers = std::array<std::array<int, 8>, 16>{ {
+    { -3, -6,  -9, -15, 2, 5, 8, 14 },
+    { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 },
+    { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 },
+    { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 },
+    { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 },
+    { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 },
+    { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 },
+    { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 },
+    { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+  } };
+
+  // https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html#ETC2
+  // fits the base and multiplier to the alpha range for each modifier table
+  void encode_eac_alpha(const Block& block, std::byte* output) {
+    auto a0 = 255;
+    auto a1 = 0;
+    for (const auto& color : block) {
+      a0 = std::min(a0, int{ color.a });
+      a1 = std::max(a1, int{ color.a });
+    }
+
+    auto best = uint64_t{ };
+    auto best_error = std::numeric_limits<int>::max();
+    for (auto table = 0u; table < 16; ++table) {
+      const auto& modifiers = eac_modifiers[table];
+      const auto range = modifiers[7] - modifiers[3];
+      const auto multiplier = std::clamp((a1 - a0 + range / 2) / range, 1, 15);
+      const auto base = std::clamp((a0 + a1 -
+        (modifiers[3] + modifiers[7]) * multiplier + 1) / 2, 0, 255);
+
+      auto data = uint64_t{ to_unsigned(base) } << 56 |
+        uint64_t{ to_unsigned(multiplier) } << 52 | uint64_t{ table } << 48;
+      auto error = 0;
+      for (auto y = 0; y < 4; ++y)
+        for (auto x = 0; x < 4; ++x) {
+          const auto alpha = int{ block[to_unsigned(y * 4 + x)].a };
+          auto index = 0u;
+          auto min_distance = std::numeric_limits<int>::max();
+          for (auto i = 0u; i < 8; ++i)
+            if (const auto distance = std::abs(alpha -
+                  std::clamp(base + modifiers[i] * multiplier, 0, 255));
+                distance < min_distance) {
+              min_distance = distance;
+              index = i;
+            }
+          error += min_distance * min_distance;
+          data |= uint64_t{ index } << (45 - 3 * get_etc_pixel_index(x, y));
+        }
+      if (error < best_error) {
+        best_error = error;
+        best = data;
+      }
+    }
+    write_be(output, best, 8);
+  }
+
+  void encode_etc2_rgba(const Block& block, std::byte* output) {
+    encode_eac_alpha(block, output);
+    encode_etc2_rgb(block, output + 8);
+  }
+} // namespace
+
+size_t get_compressed_block_size(Compression compression) {
+  switch (compression) {
+    case Compression::bc1: return 8;
+    case Compression::bc3: return 16;
+    case Compression::bc7: return 16;
+    case Compression::etc2: return 8;
+    case Compression::etc2a: return 16;
+    case Compression::undefined:
+    case Compression::none:
+      break;
+  }
+  return 0;
+}
+
+std::vector<std::byte> compress_image(const Image& image, Compression compression) {
+  const auto block_size = get_compressed_block_size(compression);
+  if (!block_size) {
+    const auto data = image.data();
+    return { data.begin(), data.end() };
+  }
+
+  const auto image_rgba = image.view<RGBA>();
+  const auto blocks_x = div_ceil(image.width(), 4);
+  const auto blocks_y = div_ceil(image.height(), 4);
+  const auto row_size = to_unsigned(blocks_x) * block_size;
+  auto output = std::vector<std::byte>(row_size * to_unsigned(blocks_y));
+
+  scheduler.for_each_parallel([&](size_t block_y) {
+    auto block_output = output.data() + block_y * row_size;
+    for (auto block_x = 0; block_x < blocks_x; ++block_x, block_output += block_size) {
+      const auto block = get_block(image_rgba, block_x, static_cast<int>(block_y));
+      switch (compression) {
+        case Compression::bc1: encode_bc1(block, true, block_output); break;
+        case Compression::bc3: encode_bc3(block, block_output); break;
+        case Compression::bc7: encode_bc7_mode6(block, block_output); break;
+        case Compression::etc2: encode_etc2_rgb(block, block_output); break;
+        case Compression::etc2a: encode_etc2_rgba(block, block_output); break;
+        case Compression::undefined:
+        case Compression::none:
+          break;
+      }
+    }
+  }, static_cast<size_t>(blocks_y));
+  return output;
+}
+
+} // namespace
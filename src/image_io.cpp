@@ -1,10 +1,14 @@
 
 #include "image.h"
+#include "archive.h"
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 #include "gifenc/gifenc.h"
+#include "miniz/miniz.h"
 #include <array>
 #include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <stdexcept>
 #include <cstring>
 #include <utility>
@@ -79,14 +83,17 @@ namespace {
     return palette;
   }
 
-  int index_of_closest_palette_color(const Palette& palette, const RGBA& color) {
+  // alpha is only considered for palettes which store it (indexed PNG)
+  int index_of_closest_palette_color(const Palette& palette, const RGBA& color,
+      bool with_alpha) {
     auto min_index = 0;
     auto min_distance = std::numeric_limits<int>::max();
     for (auto i = 0u; i < palette.size(); ++i) {
       const auto r = palette[i].r - color.r;
       const auto g = palette[i].g - color.g;
       const auto b = palette[i].b - color.b;
-      const auto distance = (r * r + g * g + b * b);
+      const auto a = (with_alpha ? palette[i].a - color.a : 0);
+      const auto distance = (r * r + g * g + b * b + a * a);
       if (distance < min_distance) {
         min_index = to_int(i);
         min_distance = distance;
@@ -95,12 +102,10 @@ namespace {
     return min_index;
   }
 
-  const RGBA& closest_palette_color(const Palette& palette, const RGBA& color) {
-    return palette[to_unsigned(index_of_closest_palette_color(palette, color))];
-  }
-
   // https://en.wikipedia.org/wiki/Floyd%E2%80%93Steinberg_dithering
-  void floyd_steinberg_dithering(ImageView<RGBA> image_rgba, const Palette& palette) {
+  // returns the palette indices, the error is diffused within image_rgba
+  Image quantize_image_dithered(ImageView<RGBA> image_rgba, const Palette& palette,
+      bool with_alpha) {
     const auto diff = [](const RGBA::Channel& a, const RGBA::Channel& b) { 
       return static_cast<int>(a) - static_cast<int>(b);
     };
@@ -109,14 +114,27 @@ namespace {
     };
     const auto w = image_rgba.width();
     const auto h = image_rgba.height();
+    auto out = Image(ImageType::Mono, w, h);
+    const auto out_mono = out.view<RGBA::Channel>();
+
+    // large uniform regions (e.g. transparent background) need no lookup
+    auto last_color = std::optional<RGBA>();
+    auto last_index = 0;
     for (auto y = 0; y < h; ++y)
       for (auto x = 0; x < w; ++x) {
         auto& color = image_rgba.value_at({ x, y });
         const auto old_color = color;
-        color = closest_palette_color(palette, color);
+        if (old_color != last_color) {
+          last_color = old_color;
+          last_index = index_of_closest_palette_color(palette, old_color, with_alpha);
+        }
+        out_mono.value_at({ x, y }) = RGBA::to_channel(last_index);
+        color = palette[to_unsigned(last_index)];
         const auto error_r = diff(old_color.r, color.r);
         const auto error_g = diff(old_color.g, color.g);
         const auto error_b = diff(old_color.b, color.b);
+        if (!error_r && !error_g && !error_b)
+          continue;
         const auto apply_error = [&](int x, int y, int fs) {
           auto& color = image_rgba.value_at({ 
             std::clamp(x, 0, w - 1), std::clamp(y, 0, h - 1)
@@ -130,9 +148,10 @@ namespace {
         apply_error(x    , y + 1, 5);
         apply_error(x + 1, y + 1, 1);
       }
+    return out;
   }
 
-  [[maybe_unused]] Palette generate_palette(const Image& image, int max_colors) {
+  Palette generate_palette(const Image& image, int max_colors) {
     auto clone = clone_image(image);
     const auto clone_rgba = clone.view<RGBA>();
     return median_cut_reduction(
@@ -155,17 +174,6 @@ namespace {
       }, max_colors);
   }
 
-  Image quantize_image(ImageView<RGBA> image_rgba, const Palette& palette) {
-    auto out = Image(ImageType::Mono, image_rgba.width(), image_rgba.height());
-    const auto out_mono = out.view<RGBA::Channel>();
-    for (auto y = 0; y < image_rgba.height(); ++y)
-      for (auto x = 0; x < image_rgba.width(); ++x)
-        out_mono.value_at({ x, y }) = RGBA::to_channel(
-          index_of_closest_palette_color(palette, 
-            image_rgba.value_at({ x, y })));
-    return out;
-  }
-
   // https://giflib.sourceforge.net/whatsinagif/
   bool write_gif(const std::string& filename, const Animation& animation) {
     if (animation.frames.empty())
@@ -187,7 +195,7 @@ namespace {
     auto transparent_index = -1;
     if (animation.color_key)
       transparent_index = index_of_closest_palette_color(
-        palette, *animation.color_key);
+        palette, *animation.color_key, false);
 
     auto width = 0;
     auto height = 0;
@@ -205,83 +213,808 @@ namespace {
     if (!gif)
       return false;
 
-    for (const auto& frame : animation.frames) {
+    // frames are quantized independently, only encoding is sequential
+    auto quantized = std::vector<Image>(animation.frames.size());
+    scheduler.for_each_parallel([&](size_t index) {
+      auto dithered = clone_image(animation.frames[index].image);
+      quantized[index] = quantize_image_dithered(dithered.view<RGBA>(), palette, false);
+    }, quantized.size());
+
+    for (auto i = 0u; i < animation.frames.size(); ++i) {
       const auto delay = std::chrono::duration_cast<
         std::chrono::duration<uint16_t, std::ratio<1, 100>>>(
-        std::chrono::duration<real>(frame.duration)).count();
+        std::chrono::duration<real>(animation.frames[i].duration)).count();
 
-      auto dithered = clone_image(frame.image);
-      floyd_steinberg_dithering(dithered.view<RGBA>(), palette);
-      const auto mono = quantize_image(dithered.view<RGBA>(), palette);
+      // gifenc only encodes the rect which changed since the previous frame
+      auto& mono = quantized[i];
       std::memcpy(gif->frame, mono.data().data(), mono.size_bytes());
+      mono = { };
       ge_add_frame(gif, delay);
     }
     ge_close_gif(gif);
     return true;
   }
+
+  // returns an empty palette when there are more than max_colors colors
+  Palette get_exact_palette(ImageView<const RGBA> image_rgba, int max_colors) {
+    auto palette = Palette();
+    auto last_color = std::optional<RGBA>();
+    for (const auto& color : span<const RGBA>(
+        image_rgba.values(), to_unsigned(image_rgba.size())))
+      if (color != last_color) {
+        last_color = color;
+        const auto it = std::lower_bound(palette.begin(), palette.end(), color);
+        if (it != palette.end() && *it == color)
+          continue;
+        if (to_int(palette.size()) == max_colors)
+          return { };
+        palette.insert(it, color);
+      }
+    return palette;
+  }
+
+  Image get_palette_indices(ImageView<const RGBA> image_rgba, const Palette& palette) {
+    auto out = Image(ImageType::Mono, image_rgba.width(), image_rgba.height());
+    auto dest = out.view<RGBA::Channel>().values();
+    auto last_color = std::optional<RGBA>();
+    auto last_index = RGBA::Channel{ };
+    for (const auto& color : span<const RGBA>(
+        image_rgba.values(), to_unsigned(image_rgba.size()))) {
+      if (color != last_color) {
+        last_color = color;
+        last_index = RGBA::to_channel(std::distance(palette.begin(),
+          std::find(palette.begin(), palette.end(), color)));
+      }
+      *dest++ = last_index;
+    }
+    return out;
+  }
+
+  // https://www.w3.org/TR/png/#4Concepts.IndexColour
+  std::string encode_indexed_png(const Image& image, int max_colors) {
+    const auto image_rgba = image.view<RGBA>();
+    auto palette = get_exact_palette(image_rgba, max_colors);
+    const auto exact = !palette.empty();
+    if (!exact)
+      palette = generate_palette(image, max_colors);
+
+    // translucent colors first, so trailing opaque colors can be omitted in tRNS
+    std::stable_partition(palette.begin(), palette.end(),
+      [](const RGBA& color) { return color.a != 255; });
+    const auto translucent_count = static_cast<size_t>(std::count_if(
+      palette.begin(), palette.end(), [](const RGBA& color) { return color.a != 255; }));
+
+    auto indices = Image();
+    if (exact) {
+      indices = get_palette_indices(image_rgba, palette);
+    }
+    else {
+      auto dithered = clone_image(image);
+      indices = quantize_image_dithered(dithered.view<RGBA>(), palette, true);
+    }
+
+    auto bit_depth = 1;
+    while ((1u << bit_depth) < palette.size())
+      bit_depth *= 2;
+
+    // pack indices into rows, each prepended by filter type none
+    const auto width = to_unsigned(image.width());
+    const auto height = to_unsigned(image.height());
+    const auto row_size = 1 + (width * to_unsigned(bit_depth) + 7) / 8;
+    auto rows = std::vector<uint8_t>(row_size * height);
+    const auto indices_mono = indices.view<RGBA::Channel>();
+    const auto pixels_per_byte = 8u / to_unsigned(bit_depth);
+    for (auto y = 0u; y < height; ++y) {
+      auto row = &rows[y * row_size + 1];
+      for (auto x = 0u; x < width; ++x) {
+        const auto shift = 8u - to_unsigned(bit_depth) * (x % pixels_per_byte + 1);
+        row[x / pixels_per_byte] = static_cast<uint8_t>(row[x / pixels_per_byte] |
+          indices_mono.value_at({ to_int(x), to_int(y) }) << shift);
+      }
+    }
+
+    auto compressed_size = mz_compressBound(static_cast<mz_ulong>(rows.size()));
+    auto compressed = std::string(compressed_size, '\0');
+    if (mz_compress2(reinterpret_cast<uint8_t*>(compressed.data()), &compressed_size,
+          rows.data(), static_cast<mz_ulong>(rows.size()), 
+          stbi_write_png_compression_level) != MZ_OK)
+      error("compressing image failed");
+    compressed.resize(compressed_size);
+
+    auto out = std::string("\x89PNG\r\n\x1A\n");
+    const auto write_u32 = [&](uint32_t value) {
+      for (auto i = 3; i >= 0; --i)
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    };
+    const auto write_chunk = [&](const char* type, const std::string& data) {
+      write_u32(static_cast<uint32_t>(data.size()));
+      const auto begin = out.size();
+      out.append(type, 4);
+      out.append(data);
+      write_u32(static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT,
+        reinterpret_cast<const uint8_t*>(out.data() + begin), out.size() - begin)));
+    };
+
+    auto header = std::string();
+    for (auto value : { width, height })
+      for (auto i = 3; i >= 0; --i)
+        header.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    header.push_back(static_cast<char>(bit_depth));
+    header.push_back(3); // indexed color
+    header.append(3, '\0'); // compression, filter, no interlace
+    write_chunk("IHDR", header);
+
+    auto plte = std::string();
+    auto trns = std::string();
+    for (const auto& color : palette) {
+      plte.push_back(static_cast<char>(color.r));
+      plte.push_back(static_cast<char>(color.g));
+      plte.push_back(static_cast<char>(color.b));
+      if (trns.size() < translucent_count)
+        trns.push_back(static_cast<char>(color.a));
+    }
+    write_chunk("PLTE", plte);
+    if (!trns.empty())
+      write_chunk("tRNS", trns);
+    write_chunk("IDAT", compressed);
+    write_chunk("IEND", { });
+    return out;
+  }
+
+  // https://qoiformat.org/qoi-specification.pdf
+  namespace qoi {
+    constexpr auto header_size = 14;
+    constexpr auto end_marker = std::string_view("\0\0\0\0\0\0\0\1", 8);
+    constexpr uint8_t op_index = 0x00;
+    constexpr uint8_t op_diff = 0x40;
+    constexpr uint8_t op_luma = 0x80;
+    constexpr uint8_t op_run = 0xC0;
+    constexpr uint8_t op_rgb = 0xFE;
+    constexpr uint8_t op_rgba = 0xFF;
+    constexpr uint8_t mask_2 = 0xC0;
+
+    int hash(const RGBA& c) {
+      return (c.r * 3 + c.g * 5 + c.b * 7 + c.a * 11) % 64;
+    }
+
+    void write_u32(std::string& out, uint32_t value) {
+      out.push_back(static_cast<char>((value >> 24) & 0xFF));
+      out.push_back(static_cast<char>((value >> 16) & 0xFF));
+      out.push_back(static_cast<char>((value >> 8) & 0xFF));
+      out.push_back(static_cast<char>(value & 0xFF));
+    }
+
+    uint32_t read_u32(const uint8_t* in) {
+      return (uint32_t{ in[0] } << 24) | (uint32_t{ in[1] } << 16) |
+             (uint32_t{ in[2] } << 8) | uint32_t{ in[3] };
+    }
+  } // namespace qoi
+
+  std::string encode_qoi(const Image& image) {
+    const auto image_rgba = image.view<RGBA>();
+    const auto put = [](std::string& out, int value) {
+      out.push_back(static_cast<char>(static_cast<uint8_t>(value)));
+    };
+
+    auto out = std::string("qoif");
+    out.reserve(image.size_bytes() / 2);
+    qoi::write_u32(out, to_unsigned(image.width()));
+    qoi::write_u32(out, to_unsigned(image.height()));
+    put(out, 4); // channels
+    put(out, 0); // sRGB with linear alpha
+
+    auto index = std::array<RGBA, 64>{ };
+    auto prev = RGBA{ 0, 0, 0, 255 };
+    auto run = 0;
+    const auto pixels = image_rgba.values();
+    const auto count = image_rgba.size();
+    for (auto i = 0; i < count; ++i) {
+      const auto& pixel = pixels[i];
+      if (pixel == prev) {
+        if (++run == 62 || i == count - 1) {
+          put(out, qoi::op_run | (run - 1));
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0) {
+        put(out, qoi::op_run | (run - 1));
+        run = 0;
+      }
+
+      auto& indexed = index[to_unsigned(qoi::hash(pixel))];
+      if (indexed == pixel) {
+        put(out, qoi::op_index | qoi::hash(pixel));
+      }
+      else {
+        indexed = pixel;
+        if (pixel.a == prev.a) {
+          const auto vr = static_cast<int8_t>(pixel.r - prev.r);
+          const auto vg = static_cast<int8_t>(pixel.g - prev.g);
+          const auto vb = static_cast<int8_t>(pixel.b - prev.b);
+          const auto vg_r = vr - vg;
+          const auto vg_b = vb - vg;
+          if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+            put(out, qoi::op_diff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+          }
+          else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                   vg_b > -9 && vg_b < 8) {
+            put(out, qoi::op_luma | (vg + 32));
+            put(out, (vg_r + 8) << 4 | (vg_b + 8));
+          }
+          else {
+            put(out, qoi::op_rgb);
+            put(out, pixel.r);
+            put(out, pixel.g);
+            put(out, pixel.b);
+          }
+        }
+        else {
+          put(out, qoi::op_rgba);
+          put(out, pixel.r);
+          put(out, pixel.g);
+          put(out, pixel.b);
+          put(out, pixel.a);
+        }
+      }
+      prev = pixel;
+    }
+    out.append(qoi::end_marker);
+    return out;
+  }
+
+  Image decode_qoi(std::string_view data) {
+    const auto in = reinterpret_cast<const uint8_t*>(data.data());
+    const auto size = data.size();
+    if (size < qoi::header_size + qoi::end_marker.size() ||
+        data.substr(0, 4) != "qoif")
+      return { };
+
+    const auto width = qoi::read_u32(in + 4);
+    const auto height = qoi::read_u32(in + 8);
+    if (!width || !height || uint64_t{ width } * height > 400'000'000)
+      return { };
+
+    auto image = Image(ImageType::RGBA, static_cast<int>(width), static_cast<int>(height));
+    const auto image_rgba = image.view<RGBA>();
+    const auto pixels = image_rgba.values();
+    const auto count = image_rgba.size();
+    const auto chunks_end = size - qoi::end_marker.size();
+    auto index = std::array<RGBA, 64>{ };
+    auto pixel = RGBA{ 0, 0, 0, 255 };
+    auto run = 0;
+    auto pos = size_t{ qoi::header_size };
+    for (auto i = 0; i < count; ++i) {
+      if (run > 0) {
+        --run;
+      }
+      else if (pos < chunks_end) {
+        const auto b1 = in[pos++];
+        if (b1 == qoi::op_rgb) {
+          pixel.r = in[pos++];
+          pixel.g = in[pos++];
+          pixel.b = in[pos++];
+        }
+        else if (b1 == qoi::op_rgba) {
+          pixel.r = in[pos++];
+          pixel.g = in[pos++];
+          pixel.b = in[pos++];
+          pixel.a = in[pos++];
+        }
+        else if ((b1 & qoi::mask_2) == qoi::op_index) {
+          pixel = index[b1];
+        }
+        else if ((b1 & qoi::mask_2) == qoi::op_diff) {
+          pixel.r = RGBA::to_channel(pixel.r + ((b1 >> 4) & 0x03) - 2);
+          pixel.g = RGBA::to_channel(pixel.g + ((b1 >> 2) & 0x03) - 2);
+          pixel.b = RGBA::to_channel(pixel.b + (b1 & 0x03) - 2);
+        }
+        else if ((b1 & qoi::mask_2) == qoi::op_luma) {
+          const auto b2 = in[pos++];
+          const auto vg = (b1 & 0x3F) - 32;
+          pixel.r = RGBA::to_channel(pixel.r + vg - 8 + ((b2 >> 4) & 0x0F));
+          pixel.g = RGBA::to_channel(pixel.g + vg);
+          pixel.b = RGBA::to_channel(pixel.b + vg - 8 + (b2 & 0x0F));
+        }
+        else {
+          run = (b1 & 0x3F);
+        }
+        index[to_unsigned(qoi::hash(pixel))] = pixel;
+      }
+      pixels[i] = pixel;
+    }
+    return image;
+  }
+
+  struct TextureFormat {
+    uint32_t vk_format;
+    uint32_t dxgi_format;
+    uint8_t khr_df_model;
+    uint8_t block_dimension;
+    uint8_t bytes_per_block;
+  };
+
+  TextureFormat get_texture_format(Compression compression) {
+    switch (compression) {
+      case Compression::bc1: return { 134, 72, 128, 4, 8 };
+      case Compression::bc3: return { 138, 78, 130, 4, 16 };
+      case Compression::bc7: return { 146, 99, 134, 4, 16 };
+      // not supported by DDS
+      case Compression::etc2: return { 148, 0, 161, 4, 8 };
+      case Compression::etc2a: return { 152, 0, 161, 4, 16 };
+      case Compression::undefined:
+      case Compression::none:
+        break;
+    }
+    // uncompressed sRGB RGBA
+    return { 43, 29, 1, 1, 4 };
+  }
+
+  template<typename T>
+  void write_le(std::string& out, T value) {
+    for (auto i = 0u; i < sizeof(T); ++i)
+      out.push_back(static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xFF));
+  }
+
+  void write_padding(std::string& out, size_t alignment) {
+    while (out.size() % alignment)
+      out.push_back('\0');
+  }
+
+  void write_data(std::string& out, span<const std::byte> data) {
+    out.append(reinterpret_cast<const char*>(data.data()), data.size());
+  }
+
+  std::filesystem::path get_mipmap_filename(
+      const std::filesystem::path& path, size_t level) {
+    return path.parent_path() / utf8_to_path(path_to_utf8(path.stem()) +
+      "-mip" + std::to_string(level) + path_to_utf8(path.extension()));
+  }
+
+  // the compressed data of a layer's mipmap levels
+  using TextureLevels = std::vector<std::vector<std::byte>>;
+
+  TextureLevels compress_texture_levels(const Image& image,
+      const std::vector<Image>& mipmaps, Compression compression) {
+    auto levels = TextureLevels();
+    levels.push_back(compress_image(image, compression));
+    for (const auto& mipmap : mipmaps)
+      levels.push_back(compress_image(mipmap, compression));
+    return levels;
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+  std::string encode_dds(int width, int height,
+      const std::vector<TextureLevels>& layers, Compression compression) {
+    const auto format = get_texture_format(compression);
+    const auto compressed = (format.block_dimension > 1);
+    const auto& levels = layers.front();
+    const auto mipmapped = (levels.size() > 1);
+    auto out = std::string("DDS ");
+    write_le<uint32_t>(out, 124);
+    write_le<uint32_t>(out, 0x1 | 0x2 | 0x4 | 0x1000 |    // caps, height, width, pixelformat
+      (compressed ? 0x80000 : 0x8) | (mipmapped ? 0x20000 : 0)); // linearsize/pitch, mipmapcount
+    write_le(out, to_unsigned(height));
+    write_le(out, to_unsigned(width));
+    write_le(out, static_cast<uint32_t>(compressed ? 
+      levels.front().size() : to_unsigned(width) * format.bytes_per_block));
+    write_le<uint32_t>(out, 0); // depth
+    write_le(out, static_cast<uint32_t>(mipmapped ? levels.size() : 0));
+    for (auto i = 0; i < 11; ++i)
+      write_le<uint32_t>(out, 0);
+
+    // pixel format
+    write_le<uint32_t>(out, 32);
+    write_le<uint32_t>(out, 0x4); // fourcc
+    out.append("DX10");
+    for (auto i = 0; i < 5; ++i)
+      write_le<uint32_t>(out, 0);
+
+    write_le<uint32_t>(out, 0x1000 | (mipmapped ? 0x8 | 0x400000 : 0)); // texture, complex, mipmap
+    for (auto i = 0; i < 4; ++i)
+      write_le<uint32_t>(out, 0);
+
+    // DX10 header extension
+    write_le(out, format.dxgi_format);
+    write_le<uint32_t>(out, 3); // texture 2D
+    write_le<uint32_t>(out, 0);
+    write_le(out, static_cast<uint32_t>(layers.size())); // array size
+    write_le<uint32_t>(out, 0);
+
+    // levels are stored per layer
+    for (const auto& layer : layers)
+      for (const auto& level : layer)
+        write_data(out, level);
+    return out;
+  }
+
+  // https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html
+  std::string get_ktx2_data_format_descriptor(Compression compression) {
+    struct Sample {
+      uint16_t bit_offset;
+      uint8_t bit_length;
+      uint8_t channel;
+      uint32_t upper;
+    };
+    const auto linear = uint8_t{ 0x10 };
+    const auto samples = [&]() -> std::vector<Sample> {
+      switch (compression) {
+        case Compression::bc1: return { { 0, 64, 1, ~0u } };
+        case Compression::bc3: return { { 0, 64, 15 | linear, ~0u }, { 64, 64, 0, ~0u } };
+        case Compression::bc7: return { { 0, 128, 0, ~0u } };
+        case Compression::etc2: return { { 0, 64, 2, ~0u } };
+        case Compression::etc2a: return { { 0, 64, 15 | linear, ~0u }, { 64, 64, 2, ~0u } };
+        case Compression::undefined:
+        case Compression::none:
+          break;
+      }
+      return { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, 
+               { 24, 8, 15 | linear, 255 } };
+    }();
+
+    const auto format = get_texture_format(compression);
+    const auto block_size = 24 + 16 * samples.size();
+    auto out = std::string();
+    write_le(out, static_cast<uint32_t>(4 + block_size));
+    write_le<uint32_t>(out, 0); // vendor id, descriptor type
+    write_le<uint16_t>(out, 2); // version
+    write_le(out, static_cast<uint16_t>(block_size));
+    write_le(out, format.khr_df_model);
+    write_le<uint8_t>(out, 1); // BT709 primaries
+    write_le<uint8_t>(out, 2); // sRGB transfer
+    write_le<uint8_t>(out, 0); // straight alpha
+    for (auto i = 0; i < 2; ++i)
+      write_le(out, static_cast<uint8_t>(format.block_dimension - 1));
+    for (auto i = 0; i < 2; ++i)
+      write_le<uint8_t>(out, 0);
+    write_le(out, format.bytes_per_block);
+    for (auto i = 0; i < 7; ++i)
+      write_le<uint8_t>(out, 0);
+    for (const auto& sample : samples) {
+      write_le(out, sample.bit_offset);
+      write_le(out, static_cast<uint8_t>(sample.bit_length - 1));
+      write_le(out, sample.channel);
+      write_le<uint32_t>(out, 0); // sample position
+      write_le<uint32_t>(out, 0); // lower
+      write_le(out, sample.upper);
+    }
+    return out;
+  }
+
+  std::string get_ktx2_key_value_data() {
+    const auto key_values = std::initializer_list<std::pair<std::string_view, std::string_view>>{
+      { "KTXwriter", "spright" },
+    };
+    auto out = std::string();
+    for (const auto& [key, value] : key_values) {
+      write_le(out, static_cast<uint32_t>(key.size() + 1 + value.size() + 1));
+      out.append(key);
+      out.push_back('\0');
+      out.append(value);
+      out.push_back('\0');
+      write_padding(out, 4);
+    }
+    return out;
+  }
+
+  // https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+  std::string encode_ktx2(int width, int height,
+      const std::vector<TextureLevels>& layers, bool array, Compression compression) {
+    const auto format = get_texture_format(compression);
+    const auto dfd = get_ktx2_data_format_descriptor(compression);
+    const auto kvd = get_ktx2_key_value_data();
+    const auto level_count = layers.front().size();
+    const auto get_level_size = [&](size_t level) {
+      auto size = size_t{ };
+      for (const auto& layer : layers)
+        size += layer[level].size();
+      return size;
+    };
+    const auto alignment = size_t{ std::max(format.bytes_per_block, uint8_t{ 4 }) };
+    const auto header_size = 80 + 24 * level_count;
+
+    auto out = std::string("\xABKTX 20\xBB\r\n\x1A\n");
+    write_le(out, format.vk_format);
+    write_le<uint32_t>(out, 1); // type size
+    write_le(out, to_unsigned(width));
+    write_le(out, to_unsigned(height));
+    write_le<uint32_t>(out, 0); // depth
+    write_le(out, static_cast<uint32_t>(array ? layers.size() : 0));
+    write_le<uint32_t>(out, 1); // face count
+    write_le(out, static_cast<uint32_t>(level_count));
+    write_le<uint32_t>(out, 0); // no supercompression
+
+    write_le(out, static_cast<uint32_t>(header_size));
+    write_le(out, static_cast<uint32_t>(dfd.size()));
+    write_le(out, static_cast<uint32_t>(header_size + dfd.size()));
+    write_le(out, static_cast<uint32_t>(kvd.size()));
+    write_le<uint64_t>(out, 0); // supercompression global data
+    write_le<uint64_t>(out, 0);
+
+    // levels are stored from smallest to largest
+    auto level_offsets = std::vector<size_t>(level_count);
+    auto offset = header_size + dfd.size() + kvd.size();
+    for (auto i = level_count; i-- > 0; ) {
+      offset = to_unsigned(ceil(static_cast<int>(offset), static_cast<int>(alignment)));
+      level_offsets[i] = offset;
+      offset += get_level_size(i);
+    }
+    for (auto i = 0u; i < level_count; ++i) {
+      write_le<uint64_t>(out, level_offsets[i]);
+      write_le<uint64_t>(out, get_level_size(i));
+      write_le<uint64_t>(out, get_level_size(i));
+    }
+    out.append(dfd);
+    out.append(kvd);
+    for (auto i = level_count; i-- > 0; ) {
+      write_padding(out, alignment);
+      for (const auto& layer : layers)
+        write_data(out, layer[i]);
+    }
+    return out;
+  }
+
+  // decoded RGBA pixels follow the header
+  struct ImageCacheHeader {
+    std::array<char, 8> magic;
+    uint64_t source_size;
+    int64_t source_time;
+    uint32_t width;
+    uint32_t height;
+  };
+  const auto image_cache_magic = std::array<char, 8>{ 
+    'S', 'P', 'R', 'R', 'G', 'B', 'A', '2' };
+
+  // keyed by path, so a changed file replaces its previous entry
+  std::filesystem::path get_image_cache_filename(
+      const std::filesystem::path& filename,
+      const std::filesystem::path& cache_path) {
+    auto error = std::error_code{ };
+    const auto path = std::filesystem::weakly_canonical(filename, error);
+    if (error)
+      return { };
+    auto hasher = Hasher();
+    hasher.add_string(path_to_utf8(path));
+    auto ss = std::ostringstream();
+    ss << std::hex << std::setfill('0') << std::setw(16) << hasher.value() << ".rgba";
+    return cache_path / ss.str();
+  }
+
+  // the size and modification time of the file validate the entry
+  std::optional<ImageCacheHeader> get_image_cache_header(
+      const std::filesystem::path& filename) {
+    auto error = std::error_code{ };
+    const auto size = std::filesystem::file_size(filename, error);
+    if (error)
+      return { };
+    const auto time = std::filesystem::last_write_time(filename, error);
+    if (error)
+      return { };
+    return ImageCacheHeader{ image_cache_magic, size,
+      static_cast<int64_t>(time.time_since_epoch().count()), 0, 0 };
+  }
+
+  Image read_cached_image(const std::filesystem::path& cache_filename,
+      const ImageCacheHeader& expected) {
+    auto error = std::error_code{ };
+    const auto size = std::filesystem::file_size(cache_filename, error);
+    if (error || size < sizeof(ImageCacheHeader))
+      return { };
+
+    auto file = std::ifstream(cache_filename, std::ios::in | std::ios::binary);
+    auto header = ImageCacheHeader{ };
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != expected.magic ||
+        header.source_size != expected.source_size ||
+        header.source_time != expected.source_time ||
+        size != sizeof(header) + size_t{ header.width } * header.height * sizeof(RGBA))
+      return { };
+
+    // pixels are read at once, without decoding
+    auto image = Image(ImageType::RGBA, static_cast<int>(header.width),
+      static_cast<int>(header.height));
+    if (!file.read(reinterpret_cast<char*>(image.data().data()), 
+          static_cast<std::streamsize>(image.size_bytes())))
+      return { };
+    return image;
+  }
+
+  // the cache is optional, failing to write it is ignored
+  void write_cached_image(const Image& image,
+      const std::filesystem::path& cache_filename, ImageCacheHeader header) {
+    auto error = std::error_code{ };
+    std::filesystem::create_directories(cache_filename.parent_path(), error);
+    const auto temp_filename = get_temporary_filename(cache_filename);
+    {
+      auto file = std::ofstream(temp_filename, std::ios::out | std::ios::binary);
+      header.width = static_cast<uint32_t>(image.width());
+      header.height = static_cast<uint32_t>(image.height());
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      file.write(reinterpret_cast<const char*>(image.data().data()),
+        static_cast<std::streamsize>(image.size_bytes()));
+      if (!file.good()) {
+        file.close();
+        std::filesystem::remove(temp_filename, error);
+        return;
+      }
+    }
+    // replace atomically, concurrent runs may write the same file
+    std::filesystem::rename(temp_filename, cache_filename, error);
+    if (error)
+      std::filesystem::remove(temp_filename, error);
+  }
+
+  void create_parent_directories(const std::filesystem::path& path) {
+    if (!path.parent_path().empty() && !is_output_bundle_open())
+      std::filesystem::create_directories(path.parent_path());
+  }
+
+  // adds the file to the output bundle, when one is open
+  void write_output_file(const std::filesystem::path& path, std::string_view data) {
+    if (!add_to_output_bundle(path, data))
+      write_textfile(path, data);
+  }
+
+  // calls one of stb's write functions with a callback, which collects the data
+  template<typename F>
+  bool write_stbi_output_file(const std::filesystem::path& path, F&& write) {
+    auto data = std::string();
+    const auto append = [](void* context, void* chunk, int size) {
+      static_cast<std::string*>(context)->append(
+        static_cast<const char*>(chunk), to_unsigned(size));
+    };
+    if (!write(+append, &data))
+      return false;
+    write_output_file(path, data);
+    return true;
+  }
+
+  bool write_gif_output_file(const std::filesystem::path& path, 
+      const Animation& animation) {
+    if (!is_output_bundle_open())
+      return write_gif(path_to_utf8(path), animation);
+
+    // the encoder writes to a file descriptor
+    const auto temp_filename = get_temporary_filename(
+      std::filesystem::temp_directory_path() / "spright.gif");
+    auto data = std::string();
+    const auto result = (write_gif(path_to_utf8(temp_filename), animation) &&
+      read_file(temp_filename, data));
+    auto error = std::error_code{ };
+    std::filesystem::remove(temp_filename, error);
+    if (result)
+      write_output_file(path, data);
+    return result;
+  }
 } // namespace
 
-Image load_image(const std::filesystem::path& filename) {
+Image decode_image(std::string_view data) {
+  if (data.substr(0, 4) == "qoif")
+    return decode_qoi(data);
+
   auto width = 0;
   auto height = 0;
-  auto data = std::add_pointer_t<std::byte>{ };
+  auto channels = 0;
+  const auto pixels = reinterpret_cast<std::byte*>(stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(data.data()), static_cast<int>(data.size()),
+    &width, &height, &channels, sizeof(RGBA)));
+  if (!pixels)
+    return { };
+  return Image(ImageType::RGBA, width, height, pixels);
+}
+
+Image load_image(const std::filesystem::path& filename) {
+  auto image = Image();
 
 #if defined(EMBED_TEST_FILES)
   if (filename == "test/Items.png") {
-    unsigned char file[] {
+    static const unsigned char file[] {
 #include "test/Items.png.inc"
     };
-    auto channels = 0;
-    data = reinterpret_cast<std::byte*>(stbi_load_from_memory(
-        file, sizeof(file), &width, &height, &channels, sizeof(RGBA)));
+    image = decode_image({ reinterpret_cast<const char*>(file), sizeof(file) });
   }
   else
 #endif
-
-#if defined(_WIN32)
-  if (auto file = _wfopen(filename.wstring().c_str(), L"rb")) {
-#else
-  if (auto file = std::fopen(path_to_utf8(filename).c_str(), "rb")) {
-#endif
-    auto channels = 0;
-    data = reinterpret_cast<std::byte*>(stbi_load_from_file(
-        file, &width, &height, &channels, sizeof(RGBA)));
-    std::fclose(file);
+  {
+    // read at once into a buffer, which is reused by the thread
+    thread_local auto buffer = std::string();
+    if (read_source_file(filename, buffer))
+      image = decode_image(buffer);
   }
-  if (!data)
+  if (!image)
     throw std::runtime_error("loading file '" + 
       path_to_utf8(filename) + "' failed");
 
-  return Image(ImageType::RGBA, width, height, data);
+  return image;
 }
 
-void save_image(const Image& image, const std::filesystem::path& path) {
-  if (!path.parent_path().empty())
-    std::filesystem::create_directories(path.parent_path());
+Image load_image(const std::filesystem::path& filename,
+    const std::filesystem::path& cache_path) {
+  if (cache_path.empty())
+    return load_image(filename);
+
+  const auto cache_filename = get_image_cache_filename(filename, cache_path);
+  const auto header = get_image_cache_header(filename);
+  if (cache_filename.empty() || !header)
+    return load_image(filename);
+
+  if (auto image = read_cached_image(cache_filename, *header))
+    return image;
+
+  auto image = load_image(filename);
+  write_cached_image(image, cache_filename, *header);
+  return image;
+}
+
+void save_image(const Image& image, const std::filesystem::path& path,
+    Compression compression, const std::vector<Image>& mipmaps, int max_colors) {
+  create_parent_directories(path);
   const auto filename = path_to_utf8(path);
 
   const auto result = [&]() -> bool {
     const auto extension = to_lower(path_to_utf8(path.extension()));
+    if (max_colors && extension != ".png" && extension != ".gif")
+      error("palette is not supported by file format '", filename, "'");
+
+    if (extension == ".dds" || extension == ".ktx2") {
+      if (compression == Compression::undefined)
+        compression = Compression::bc7;
+      if (extension == ".dds" && !get_texture_format(compression).dxgi_format)
+        error("compression is not supported by file format '", filename, "'");
+      const auto layers = std::vector<TextureLevels>{
+        compress_texture_levels(image, mipmaps, compression) };
+      write_output_file(path, extension == ".dds" ?
+        encode_dds(image.width(), image.height(), layers, compression) :
+        encode_ktx2(image.width(), image.height(), layers, false, compression));
+      return true;
+    }
+
+    if (compression != Compression::undefined && 
+        compression != Compression::none)
+      error("compression is not supported by file format '", filename, "'");
+
+    // formats without mipmap support get a file per level
+    for (auto i = 0u; i < mipmaps.size(); ++i)
+      save_image(mipmaps[i], get_mipmap_filename(path, i + 1), 
+        compression, { }, max_colors);
+
     if (extension == ".gif") {
       auto animation = Animation{ };
       animation.frames.push_back({ 0, clone_image(image), 0.0 });
-      return write_gif(filename, animation);
+      animation.max_colors = max_colors;
+      return write_gif_output_file(path, animation);
+    }
+
+    if (extension == ".png" && max_colors) {
+      write_output_file(path, encode_indexed_png(image, max_colors));
+      return true;
     }
 
     const auto comp = to_int(sizeof(RGBA));
     const auto image_rgba = image.view<RGBA>();
     if (extension == ".png")
-      return stbi_write_png(filename.c_str(),
-        image.width(), image.height(), comp, image_rgba.values(), 0);
+      return write_stbi_output_file(path, [&](auto func, void* context) {
+        return stbi_write_png_to_func(func, context,
+          image.width(), image.height(), comp, image_rgba.values(), 0);
+      });
 
     if (extension == ".bmp")
-      return stbi_write_bmp(filename.c_str(),
-        image.width(), image.height(), comp, image_rgba.values());
+      return write_stbi_output_file(path, [&](auto func, void* context) {
+        return stbi_write_bmp_to_func(func, context,
+          image.width(), image.height(), comp, image_rgba.values());
+      });
+
+    if (extension == ".qoi") {
+      write_output_file(path, encode_qoi(image));
+      return true;
+    }
 
     stbi_write_tga_with_rle = 1;
     if (extension == ".tga")
-      return stbi_write_tga(filename.c_str(), 
-        image.width(), image.height(), comp, image_rgba.values());
+      return write_stbi_output_file(path, [&](auto func, void* context) {
+        return stbi_write_tga_to_func(func, context,
+          image.width(), image.height(), comp, image_rgba.values());
+      });
 
     error("unsupported image file format '", filename, "'");
   }();
@@ -289,12 +1022,39 @@ void save_image(const Image& image, const std::filesystem::path& path) {
     error("writing file '", filename, "' failed");
 }
 
+void save_image_array(const std::vector<Image>& layers,
+    const std::filesystem::path& path, Compression compression,
+    const std::vector<std::vector<Image>>& layer_mipmaps) {
+  check(!layers.empty(), "texture array without layers");
+  create_parent_directories(path);
+  const auto filename = path_to_utf8(path);
+  const auto extension = to_lower(path_to_utf8(path.extension()));
+  if (extension != ".dds" && extension != ".ktx2")
+    error("texture arrays are not supported by file format '", filename, "'");
+
+  const auto [width, height] = layers.front().bounds().size();
+  if (compression == Compression::undefined)
+    compression = Compression::bc7;
+  if (extension == ".dds" && !get_texture_format(compression).dxgi_format)
+    error("compression is not supported by file format '", filename, "'");
+  const auto no_mipmaps = std::vector<Image>();
+  auto compressed = std::vector<TextureLevels>();
+  for (auto i = 0u; i < layers.size(); ++i) {
+    check(layers[i].width() == width && layers[i].height() == height,
+      "texture array layers differ in size");
+    compressed.push_back(compress_texture_levels(layers[i], 
+      i < layer_mipmaps.size() ? layer_mipmaps[i] : no_mipmaps, compression));
+  }
+  write_output_file(path, extension == ".dds" ?
+    encode_dds(width, height, compressed, compression) :
+    encode_ktx2(width, height, compressed, true, compression));
+}
+
 void save_animation(const Animation& animation, const std::filesystem::path& path) {
-  if (!path.parent_path().empty())
-    std::filesystem::create_directories(path.parent_path());
+  create_parent_directories(path);
   const auto filename = path_to_utf8(path);
   const auto extension = to_lower(path_to_utf8(path.extension()));
-  if (!(extension == ".gif" && write_gif(filename, animation)))
+  if (!(extension == ".gif" && write_gif_output_file(path, animation)))
     error("writing file '", filename, "' failed");
 }
 
@@ -24,14 +24,17 @@ struct AnchorT : PointT<T> {
 using Anchor = AnchorT<int>;
 using AnchorF = AnchorT<real>;
 
-enum class Trim { none, rect, convex };
+enum class Trim { none, rect, convex, polygon };
 
 enum class Alpha { keep, opaque, clear, bleed, premultiply, colorkey };
 
-enum class Pack { binpack, rows, columns, compact, origin, single, layers, keep };
+enum class Pack { binpack, rows, columns, compact, origin, single, layers, keep, 
+  compact_physics };
 
 enum class Duplicates { keep, share, drop };
 
+enum class DescriptionFormat { undefined, json, cbor, msgpack, ubjson, binary };
+
 struct Extrude {
   int count;
   WrapMode mode;
@@ -86,6 +89,12 @@ struct Output {
   RGBA alpha_color{ };
   real scale{ };
   ResizeFilter scale_filter{ };
+  Compression compression{ };
+  bool mipmaps{ };
+  int mipmap_levels{ };
+  int mipmap_bleed_free_level{ };
+  bool array{ };
+  int palette_colors{ };
   bool debug{ };
 };
 
@@ -105,6 +114,8 @@ struct Sheet {
   int border_padding{ };
   int shape_padding{ };
   Duplicates duplicates{ };
+  bool stable{ };
+  real max_fragmentation{ };
   Pack pack{ };
 };
 
@@ -126,6 +137,7 @@ struct Sprite {
   int trim_margin{ };
   int trim_threshold{ };
   bool trim_gray_levels{ };
+  int trim_max_vertices{ };
   bool crop{ };
   bool crop_pivot{ };
   Extrude extrude{ };
@@ -157,6 +169,7 @@ struct Sprite {
 struct Description {
   std::filesystem::path filename;
   std::filesystem::path template_filename;
+  DescriptionFormat format{ };
 };
 
 struct InputDefinition {
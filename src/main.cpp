@@ -3,6 +3,7 @@
 #include "trimming.h"
 #include "packing.h"
 #include "output.h"
+#include "archive.h"
 #include <iostream>
 #include <chrono>
 
@@ -24,27 +25,37 @@ int main(int argc, const char* argv[]) try {
   auto [inputs, sprites, descriptions, variables] = parse_definition(settings);  
   time_points.emplace_back(Clock::now(), "input");
 
+  if (!settings.bundle_file.empty() && settings.mode != Mode::autocomplete)
+    open_output_bundle(settings.bundle_file);
+
   auto slices = std::vector<Slice>();
   auto textures = std::vector<Texture>();
+  auto trim_cache = TrimCache();
   if (settings.mode != Mode::autocomplete &&
       settings.mode != Mode::describe_input) {
     transform_sprites(sprites);
     time_points.emplace_back(Clock::now(), "transforming");
 
-    trim_sprites(sprites);
+    trim_cache = trim_sprites(sprites, read_trim_cache(settings));
     time_points.emplace_back(Clock::now(), "trimming");
 
-    slices = pack_sprites(sprites);
+    slices = pack_sprites(sprites, read_packing_layout(settings));
     textures = get_textures(settings, slices);
     evaluate_expressions(settings, sprites, textures, variables);
     time_points.emplace_back(Clock::now(), "packing");
 
     if (settings.mode != Mode::describe) {
-      if (settings.mode != Mode::rebuild &&
-          settings.input_file != "stdin")
+      if (!settings.manifest_file.empty())
+        apply_texture_manifest(settings, textures);
+      // bundled textures are always written
+      else if (!is_output_bundle_open() &&
+               settings.mode != Mode::rebuild &&
+               settings.input_file != "stdin")
         update_last_source_written_times(slices);
 
       output_textures(textures);
+      if (!settings.manifest_file.empty())
+        write_texture_manifest(settings, sprites, textures, trim_cache);
       time_points.emplace_back(Clock::now(), "output textures");
     }
 
@@ -60,6 +71,7 @@ int main(int argc, const char* argv[]) try {
     output_descriptions(settings, descriptions, 
       inputs, sprites, slices, textures, variables);
 
+    close_output_bundle();
     time_points.emplace_back(Clock::now(), "output description");
   }
 
@@ -1,14 +1,30 @@
 #pragma once
 
 #include "packing.h"
+#include "trimming.h"
 
 namespace spright {
 
+// content hashes, only computed when a manifest is used
+struct TextureHashes {
+  uint64_t input{ };
+  uint64_t layout{ };
+  std::vector<uint64_t> sprites;
+  uint64_t image{ };
+};
+
 struct Texture {
   const Slice* slice;
   const Output* output;
   std::filesystem::path filename;
   int map_index;
+  // all slices of a texture array output, shared by its textures
+  std::shared_ptr<const std::vector<const Slice*>> layer_slices;
+  int layer_index;
+  std::optional<TextureHashes> hashes;
+  // hashes when the existing file was written
+  std::optional<TextureHashes> written_hashes;
+  bool up_to_date{ };
 };
 
 std::vector<Texture> get_textures(const Settings& settings,
@@ -38,8 +54,16 @@ void output_descriptions(
   const std::vector<Texture>& textures,
   const VariantMap& variables);
 
+Size get_texture_size(const Texture& texture);
+int get_texture_layer_count(const Texture& texture);
 Image get_slice_image(const Slice& slice, int map_index = -1);
 Animation get_slice_animation(const Slice& slice, int map_index = -1);
 void output_textures(std::vector<Texture>& textures);
+void apply_texture_manifest(const Settings& settings, std::vector<Texture>& textures);
+void write_texture_manifest(const Settings& settings,
+  const std::vector<Sprite>& sprites, const std::vector<Texture>& textures,
+  const TrimCache& trim_cache);
+PackingLayout read_packing_layout(const Settings& settings);
+TrimCache read_trim_cache(const Settings& settings);
 
 } // namespace
@@ -1,7 +1,12 @@
 
 #include "output.h"
+#include "archive.h"
 #include "inja/inja.hpp"
 #include <fstream>
+#include <set>
+#include <functional>
+#include <unordered_map>
+#include <cstring>
 
 namespace spright {
 
@@ -40,12 +45,91 @@ namespace {
     return json_map;
   }
 
+  // references the described sprites, slices and textures with their output indices
+  struct DescribedSprite {
+    const Sprite* sprite;
+    int index;
+    int slice_index;
+    int layer;
+  };
+
+  struct DescribedTexture {
+    const Texture* texture;
+    int slice_index;
+  };
+
+  struct DescriptionScope {
+    std::vector<DescribedSprite> sprites;
+    std::vector<int> slice_indices;
+    std::vector<DescribedTexture> textures;
+  };
+
+  // layer of a sprite within its slice's textures, layered slices have one per sprite
+  int get_sprite_layer(const Slice& slice, const Sprite& sprite) {
+    return (slice.layered ? static_cast<int>(&sprite - slice.sprites.data()) : 0);
+  }
+
+  DescriptionScope get_description_scope(
+      const std::vector<Sprite>& sprites,
+      const std::vector<Slice>& slices,
+      const std::vector<Texture>& textures) {
+
+    auto sprite_on_slice = std::unordered_map<int, std::pair<int, int>>();
+    for (const auto& slice : slices)
+      for (const auto& sprite : slice.sprites)
+        sprite_on_slice[sprite.index] = { slice.index, get_sprite_layer(slice, sprite) };
+
+    auto scope = DescriptionScope();
+    scope.sprites.reserve(sprites.size());
+    for (const auto& sprite : sprites) {
+      auto slice_index = sprite.slice_index;
+      auto layer = 0;
+      if (slice_index >= 0)
+        if (const auto it = sprite_on_slice.find(sprite.index); it != sprite_on_slice.end())
+          std::tie(slice_index, layer) = it->second;
+      scope.sprites.push_back({ &sprite, sprite.index, slice_index, layer });
+    }
+    std::sort(scope.sprites.begin(), scope.sprites.end(),
+      [](const DescribedSprite& a, const DescribedSprite& b) { return a.index < b.index; });
+
+    for (const auto& slice : slices)
+      scope.slice_indices.push_back(slice.index);
+    for (const auto& texture : textures)
+      scope.textures.push_back({ &texture, texture.slice->index });
+    return scope;
+  }
+
+  // collects the sprites and textures of each slice in a single pass,
+  // sprite and slice indices are renumbered starting at 0
+  std::vector<DescriptionScope> get_slice_description_scopes(
+      const std::vector<Sprite>& sprites,
+      const std::vector<Slice>& slices,
+      const std::vector<Texture>& textures) {
+
+    auto scopes = std::vector<DescriptionScope>(slices.size());
+    auto scope_by_slice_index = std::unordered_map<int, size_t>();
+    for (auto i = 0u; i < slices.size(); ++i) {
+      scopes[i].slice_indices = { 0 };
+      scope_by_slice_index[slices[i].index] = i;
+    }
+    for (const auto& sprite : sprites)
+      if (const auto it = scope_by_slice_index.find(sprite.slice_index);
+          it != scope_by_slice_index.end()) {
+        auto& slice_sprites = scopes[it->second].sprites;
+        slice_sprites.push_back({ &sprite, to_int(slice_sprites.size()), 0,
+          get_sprite_layer(slices[it->second], sprite) });
+      }
+    for (const auto& texture : textures)
+      if (const auto it = scope_by_slice_index.find(texture.slice->index);
+          it != scope_by_slice_index.end())
+        scopes[it->second].textures.push_back({ &texture, 0 });
+    return scopes;
+  }
+
   nlohmann::json get_json_description(
       const Settings& settings,
       const std::vector<Input>& inputs, 
-      const std::vector<Sprite>& sprites,
-      const std::vector<Slice>& slices,
-      const std::vector<Texture>& textures,
+      const DescriptionScope& scope,
       const VariantMap& variables) {
 
     using TagKey = std::string;
@@ -57,19 +141,12 @@ namespace {
     auto tags = std::map<TagKey, std::map<TagValue, std::vector<SpriteIndex>>>();
     auto source_indices = std::map<ImageFilePtr, SourceIndex>();
     auto slice_sprites = std::map<SliceIndex, std::vector<SpriteIndex>>();
-    auto sprite_on_slice = std::map<SpriteIndex, SliceIndex>();
-    auto sprites_by_index = std::map<SpriteIndex, const Sprite*>();
     auto input_source_sprites = std::map<std::pair<InputIndex, SourceIndex>, std::vector<SpriteIndex>>();
-    for (const auto& sprite : sprites)
-      sprites_by_index[sprite.index] = &sprite;
-    for (const auto& slice : slices)
-      for (const auto& sprite : slice.sprites)
-        sprite_on_slice[sprite.index] = slice.index;
 
     auto json = nlohmann::json{ };
     auto& json_sprites = json["sprites"];
     json_sprites = nlohmann::json::array();
-    for (const auto& [sprite_index, sprite] : sprites_by_index) {
+    for (const auto& [sprite, sprite_index, slice_index, layer] : scope.sprites) {
       auto& json_sprite = json_sprites.emplace_back();
       json_sprite["index"] = sprite_index;
 
@@ -93,12 +170,10 @@ namespace {
         tags[key][value].push_back(sprite_index);
 
       // only available when packing was executed
-      if (sprite->slice_index >= 0) {
-        auto slice_index = sprite->slice_index;
-        if (const auto it = sprite_on_slice.find(sprite_index); it != sprite_on_slice.end())
-          slice_index = it->second;
+      if (slice_index >= 0) {
         json_sprite["sliceIndex"] = slice_index;
         json_sprite["sliceSpriteIndex"] = slice_sprites[slice_index].size();
+        json_sprite["layer"] = layer;
         json_sprite["rect"] = json_rect(sprite->rect);
         json_sprite["trimmedRect"] = json_rect(sprite->trimmed_rect);
         json_sprite["trimmedSourceRect"] = json_rect(sprite->trimmed_source_rect);
@@ -119,9 +194,9 @@ namespace {
 
     auto& json_slices = json["slices"];
     json_slices = nlohmann::json::array();
-    for (const auto& slice : slices) {
+    for (const auto slice_index : scope.slice_indices) {
       auto& json_slice = json_slices.emplace_back();
-      json_slice["spriteIndices"] = slice_sprites[slice.index];
+      json_slice["spriteIndices"] = slice_sprites[slice_index];
     }
 
     auto& json_sources = json["sources"];
@@ -154,22 +229,25 @@ namespace {
 
     auto& json_textures = json["textures"];
     json_textures = nlohmann::json::array();
-    for (const auto& texture : textures) {
+    for (const auto& [texture_ptr, slice_index] : scope.textures) {
+      const auto& texture = *texture_ptr;
       if (texture.filename.empty())
         continue;
 
       auto& json_texture = json_textures.emplace_back();
-      const auto& slice = *texture.slice;
       const auto& output = *texture.output;
-      json_texture["sliceIndex"] = texture.slice->index;
-      json_texture["spriteIndices"] = slice_sprites[slice.index];
+      json_texture["sliceIndex"] = slice_index;
+      json_texture["spriteIndices"] = slice_sprites[slice_index];
       json_texture["path"] = path_to_utf8(settings.output_path);
       json_texture["filename"] = path_to_utf8(
         settings.output_path.empty() ? texture.filename :
           std::filesystem::relative(texture.filename, settings.output_path));
       json_texture["scale"] = output.scale;
-      json_texture["width"] = to_int(slice.width * output.scale);
-      json_texture["height"] = to_int(slice.height * output.scale);
+      const auto [width, height] = get_texture_size(texture);
+      json_texture["width"] = width;
+      json_texture["height"] = height;
+      json_texture["layer"] = texture.layer_index;
+      json_texture["layers"] = get_texture_layer_count(texture);
       json_texture["map"] = (texture.map_index < 0 ?
         texture.output->default_map_suffix :
         texture.output->map_suffixes.at(to_unsigned(texture.map_index)));
@@ -181,6 +259,360 @@ namespace {
     return json;
   }
 
+  // writes the same format as nlohmann::json::dump(1, '\t')
+  class JsonWriter {
+  public:
+    explicit JsonWriter(std::ostream& os) : m_os(os) { }
+
+    JsonWriter& key(std::string_view key) {
+      begin_element();
+      write_string(key);
+      m_os << ": ";
+      m_after_key = true;
+      return *this;
+    }
+
+    void begin_object() { begin('{'); }
+    void end_object() { end('}'); }
+    void begin_array() { begin('['); }
+    void end_array() { end(']'); }
+
+    // like the patched nlohmann::json, number arrays are not pretty printed
+    void begin_number_array() { begin('[', true); }
+    void end_number_array() { end(']'); }
+
+    void value(int value) { begin_element(); m_os << value; }
+    void value(size_t value) { begin_element(); m_os << value; }
+    void value(bool value) { begin_element(); m_os << (value ? "true" : "false"); }
+    void value(real value) { begin_element(); m_os << nlohmann::json(value).dump(); }
+    void value(std::string_view value) { begin_element(); write_string(value); }
+    void value(const char* value) { this->value(std::string_view(value)); }
+    void value(const std::string& value) { this->value(std::string_view(value)); }
+    void value(const Variant& variant) {
+      std::visit([&](const auto& v) { value(v); }, variant);
+    }
+
+    template<typename T>
+    void value(const std::vector<T>& values) {
+      begin('[', std::is_arithmetic_v<T>);
+      for (const auto& value : values)
+        this->value(value);
+      end(']');
+    }
+
+    void value(const PointF& point) {
+      begin_object();
+      key("x").value(point.x);
+      key("y").value(point.y);
+      end_object();
+    }
+
+    void value(const Rect& rect) {
+      // keys are sorted like in nlohmann::json
+      begin_object();
+      key("h").value(rect.h);
+      key("w").value(rect.w);
+      key("x").value(rect.x);
+      key("y").value(rect.y);
+      end_object();
+    }
+
+    template<typename T, typename C>
+    void value(const std::map<std::string, T, C>& map) {
+      begin_object();
+      for (const auto& [k, v] : map)
+        key(k).value(v);
+      end_object();
+    }
+
+    void compact_point_list(const std::vector<PointF>& points) {
+      begin_number_array();
+      for (const auto& point : points) {
+        value(point.x);
+        value(point.y);
+      }
+      end_number_array();
+    }
+
+  private:
+    struct Container {
+      bool empty;
+      bool compact;
+    };
+
+    void begin_element() {
+      if (std::exchange(m_after_key, false) || m_containers.empty())
+        return;
+      auto& container = m_containers.back();
+      const auto first = std::exchange(container.empty, false);
+      if (container.compact) {
+        if (!first)
+          m_os.put(',');
+        return;
+      }
+      m_os << (first ? "\n" : ",\n");
+      indent();
+    }
+
+    void begin(char bracket, bool compact = false) {
+      begin_element();
+      m_os.put(bracket);
+      m_containers.push_back({ true, compact });
+    }
+
+    void end(char bracket) {
+      const auto container = m_containers.back();
+      m_containers.pop_back();
+      if (!container.empty && !container.compact) {
+        m_os.put('\n');
+        indent();
+      }
+      m_os.put(bracket);
+    }
+
+    void indent() {
+      for (auto i = 0u; i < m_containers.size(); ++i)
+        m_os.put('\t');
+    }
+
+    void write_string(std::string_view string) {
+      // only escape using nlohmann::json when necessary
+      if (std::all_of(string.begin(), string.end(), [](char c) {
+            return (c >= 0x20 && c != '"' && c != '\\'); })) {
+        m_os.put('"');
+        m_os.write(string.data(), static_cast<std::streamsize>(string.size()));
+        m_os.put('"');
+      }
+      else {
+        m_os << nlohmann::json(string).dump();
+      }
+    }
+
+    std::ostream& m_os;
+    std::vector<Container> m_containers;
+    bool m_after_key{ };
+  };
+
+  // streams the same description as get_json_description without building a DOM
+  void write_json_description(std::ostream& os,
+      const Settings& settings,
+      const std::vector<Input>& inputs, 
+      const DescriptionScope& scope,
+      const VariantMap& variables) {
+
+    using SpriteIndex = int;
+    const auto& sprites = scope.sprites;
+    auto max_slice_index = 0;
+    for (const auto slice_index : scope.slice_indices)
+      max_slice_index = std::max(max_slice_index, slice_index + 1);
+    for (const auto& sprite : sprites)
+      max_slice_index = std::max(max_slice_index, sprite.slice_index + 1);
+
+    // collect indices in first pass
+    struct InputSourceSprite { int input_index; int source_index; SpriteIndex sprite_index; };
+    struct TagSprite { const std::string* key; const std::string* value; SpriteIndex sprite_index; };
+    auto sources = std::vector<const ImageFile*>();
+    auto source_indices = std::unordered_map<const ImageFile*, int>();
+    auto sprite_source_indices = std::vector<int>(sprites.size());
+    auto sprite_slice_sprite_indices = std::vector<size_t>(sprites.size());
+    auto slice_sprites = std::vector<std::vector<SpriteIndex>>(to_unsigned(max_slice_index));
+    auto input_source_sprites = std::vector<InputSourceSprite>();
+    auto tag_sprites = std::vector<TagSprite>();
+    for (auto i = 0u; i < sprites.size(); ++i) {
+      const auto& [sprite, sprite_index, slice_index, layer] = sprites[i];
+      if (!sprite->sheet)
+        continue;
+
+      const auto [it, inserted] = source_indices.emplace(
+        sprite->source.get(), to_int(sources.size()));
+      if (inserted)
+        sources.push_back(sprite->source.get());
+      sprite_source_indices[i] = it->second;
+      input_source_sprites.push_back({ sprite->input_index, it->second, sprite_index });
+
+      for (const auto& [key, value] : sprite->tags)
+        tag_sprites.push_back({ &key, &value, sprite_index });
+
+      if (slice_index >= 0) {
+        auto& indices = slice_sprites[to_unsigned(slice_index)];
+        sprite_slice_sprite_indices[i] = indices.size();
+        indices.push_back(sprite_index);
+      }
+    }
+    std::stable_sort(input_source_sprites.begin(), input_source_sprites.end(),
+      [](const InputSourceSprite& a, const InputSourceSprite& b) {
+        return std::tie(a.input_index, a.source_index) < 
+               std::tie(b.input_index, b.source_index);
+      });
+    std::stable_sort(tag_sprites.begin(), tag_sprites.end(),
+      [](const TagSprite& a, const TagSprite& b) {
+        return std::tie(*a.key, *a.value) < std::tie(*b.key, *b.value);
+      });
+
+    const auto empty = std::vector<SpriteIndex>();
+    const auto get_slice_sprites = [&](int slice_index) -> const std::vector<SpriteIndex>& {
+      return (slice_index >= 0 && slice_index < max_slice_index ?
+        slice_sprites[to_unsigned(slice_index)] : empty);
+    };
+
+    const auto write_inputs = [&](JsonWriter& writer) {
+      writer.begin_array();
+      for (const auto& input : inputs) {
+        writer.begin_object();
+        writer.key("filename").value(input.source_filenames);
+        writer.key("sources").begin_array();
+        for (const auto& source : input.sources) {
+          const auto it = source_indices.find(source.get());
+          const auto source_index = (it != source_indices.end() ? it->second : 0);
+          const auto [begin, end] = std::equal_range(
+            input_source_sprites.begin(), input_source_sprites.end(),
+            InputSourceSprite{ input.index, source_index, 0 },
+            [](const InputSourceSprite& a, const InputSourceSprite& b) {
+              return std::tie(a.input_index, a.source_index) < 
+                     std::tie(b.input_index, b.source_index);
+            });
+          writer.begin_object();
+          writer.key("index").value(source_index);
+          writer.key("spriteIndices").begin_number_array();
+          for (auto it = begin; it != end; ++it)
+            writer.value(it->sprite_index);
+          writer.end_number_array();
+          writer.end_object();
+        }
+        writer.end_array();
+        writer.end_object();
+      }
+      writer.end_array();
+    };
+
+    const auto write_slices = [&](JsonWriter& writer) {
+      writer.begin_array();
+      for (const auto slice_index : scope.slice_indices) {
+        writer.begin_object();
+        writer.key("spriteIndices").value(get_slice_sprites(slice_index));
+        writer.end_object();
+      }
+      writer.end_array();
+    };
+
+    const auto write_sources = [&](JsonWriter& writer) {
+      writer.begin_array();
+      for (const auto* source : sources) {
+        writer.begin_object();
+        writer.key("filename").value(path_to_utf8(source->filename()));
+        writer.key("height").value(source->height());
+        writer.key("path").value(path_to_utf8(source->path()));
+        writer.key("width").value(source->width());
+        writer.end_object();
+      }
+      writer.end_array();
+    };
+
+    const auto write_sprites = [&](JsonWriter& writer) {
+      writer.begin_array();
+      for (auto i = 0u; i < sprites.size(); ++i) {
+        const auto& sprite = *sprites[i].sprite;
+        const auto slice_index = sprites[i].slice_index;
+        writer.begin_object();
+        // output no more for dropped sprites
+        if (!sprite.sheet) {
+          writer.key("index").value(sprites[i].index);
+          writer.end_object();
+          continue;
+        }
+        const auto packed = (slice_index >= 0);
+        writer.key("data").value(sprite.data);
+        writer.key("id").value(sprite.id);
+        writer.key("index").value(sprites[i].index);
+        writer.key("inputIndex").value(sprite.input_index);
+        writer.key("inputSpriteIndex").value(sprite.input_sprite_index);
+        if (packed) {
+          writer.key("layer").value(sprites[i].layer);
+          writer.key("pivot").value(sprite.pivot);
+          writer.key("rect").value(sprite.rect);
+          writer.key("rotated").value(sprite.rotated);
+          writer.key("sliceIndex").value(slice_index);
+          writer.key("sliceSpriteIndex").value(sprite_slice_sprite_indices[i]);
+        }
+        writer.key("sourceIndex").value(sprite_source_indices[i]);
+        writer.key("sourceRect").value(sprite.source_rect);
+        writer.key("tags").value(sprite.tags);
+        if (packed) {
+          writer.key("trimmedRect").value(sprite.trimmed_rect);
+          writer.key("trimmedSourceRect").value(sprite.trimmed_source_rect);
+          writer.key("vertices").compact_point_list(sprite.vertices);
+        }
+        writer.end_object();
+      }
+      writer.end_array();
+    };
+
+    const auto write_tags = [&](JsonWriter& writer) {
+      writer.begin_object();
+      for (auto it = tag_sprites.begin(); it != tag_sprites.end(); ) {
+        writer.key(*it->key).begin_object();
+        for (const auto* key = it->key; it != tag_sprites.end() && *it->key == *key; ) {
+          writer.key(*it->value).begin_number_array();
+          for (const auto* value = it->value; it != tag_sprites.end() && 
+              *it->key == *key && *it->value == *value; ++it)
+            writer.value(it->sprite_index);
+          writer.end_number_array();
+        }
+        writer.end_object();
+      }
+      writer.end_object();
+    };
+
+    const auto write_textures = [&](JsonWriter& writer) {
+      writer.begin_array();
+      for (const auto& [texture_ptr, slice_index] : scope.textures) {
+        const auto& texture = *texture_ptr;
+        if (texture.filename.empty())
+          continue;
+        const auto& output = *texture.output;
+        const auto [width, height] = get_texture_size(texture);
+        writer.begin_object();
+        writer.key("filename").value(path_to_utf8(
+          settings.output_path.empty() ? texture.filename :
+            std::filesystem::relative(texture.filename, settings.output_path)));
+        writer.key("height").value(height);
+        writer.key("layer").value(texture.layer_index);
+        writer.key("layers").value(get_texture_layer_count(texture));
+        writer.key("map").value(texture.map_index < 0 ?
+          output.default_map_suffix :
+          output.map_suffixes.at(to_unsigned(texture.map_index)));
+        writer.key("path").value(path_to_utf8(settings.output_path));
+        writer.key("scale").value(output.scale);
+        writer.key("sliceIndex").value(slice_index);
+        writer.key("spriteIndices").value(get_slice_sprites(slice_index));
+        writer.key("width").value(width);
+        writer.end_object();
+      }
+      writer.end_array();
+    };
+
+    // top-level keys are sorted, variables replace sections with the same key
+    using WriteSection = std::function<void(JsonWriter&)>;
+    auto sections = std::map<std::string_view, WriteSection>{
+      { "inputs", write_inputs },
+      { "slices", write_slices },
+      { "sources", write_sources },
+      { "sprites", write_sprites },
+      { "tags", write_tags },
+      { "textures", write_textures },
+    };
+    for (const auto& [key, value] : variables)
+      sections[key] = [v = &value](JsonWriter& writer) { writer.value(*v); };
+
+    auto writer = JsonWriter(os);
+    writer.begin_object();
+    for (const auto& [key, write_section] : sections) {
+      writer.key(key);
+      write_section(writer);
+    }
+    writer.end_object();
+  }
+
   inja::Environment setup_inja_environment() {
     auto env = inja::Environment();
     env.set_trim_blocks(false);
@@ -216,49 +648,264 @@ namespace {
     return env;
   }
 
-  void output_description(std::ostream& os,
-      const std::filesystem::path& template_filename,
-      const nlohmann::json& json) {
-    if (!template_filename.empty()) {
-      auto env = setup_inja_environment();
-      env.render_to(os, env.parse_template(
-        path_to_utf8(template_filename)), json);
+  // parses each template file once, the parsed templates can then be
+  // rendered concurrently
+  class TemplateCache {
+  public:
+    TemplateCache() : m_environment(setup_inja_environment()) { }
+
+    void parse(const std::filesystem::path& filename) {
+      if (!m_templates.count(filename))
+        m_templates.emplace(filename, 
+          m_environment.parse_template(path_to_utf8(filename)));
     }
-    else {
-      os << json.dump(1, '\t');
+
+    void render_to(std::ostream& os, const std::filesystem::path& filename,
+        const nlohmann::json& json) {
+      m_environment.render_to(os, m_templates.at(filename), json);
     }
-  }
 
-  auto filter_by_slice(int slice_index,
-      const Slice& sole_slice,
-      const std::vector<Sprite>& sprites, 
-      const std::vector<Texture>& textures) ->
-      std::tuple<std::vector<Sprite>, std::vector<Texture>> {
-    
-    auto slice_sprites = std::vector<Sprite>();
-    std::copy_if(sprites.begin(), sprites.end(),
-      std::back_inserter(slice_sprites),
-      [&](const Sprite& sprite) {
-        return (sprite.slice_index == slice_index);
-      });
+  private:
+    inja::Environment m_environment;
+    std::map<std::filesystem::path, inja::Template> m_templates;
+  };
+
+  // layout is described in docs/spright_binary.h
+  class BinaryDescriptionWriter {
+  public:
+    explicit BinaryDescriptionWriter(const nlohmann::json& json) {
+      const auto& sprites = json["sprites"];
+      const auto& textures = json["textures"];
+      const auto sprite_count = sprites.size();
+      const auto texture_count = textures.size();
 
-    auto index = 0;
-    for (auto& sprite : slice_sprites) {
-      sprite.index = index++;
-      sprite.slice_index = 0;
+      auto ids = std::vector<uint32_t>();
+      auto slice_indices = std::vector<int32_t>();
+      auto rects = std::vector<int32_t>();
+      auto trimmed_rects = std::vector<int32_t>();
+      auto pivots = std::vector<float>();
+      auto rotated = std::vector<uint32_t>();
+      auto vertex_ranges = std::vector<uint32_t>();
+      auto vertices = std::vector<float>();
+      const auto add_rect = [](std::vector<int32_t>& rects, const nlohmann::json& rect) {
+        for (const auto key : { "x", "y", "w", "h" })
+          rects.push_back(rect.is_object() ? rect[key].get<int32_t>() : 0);
+      };
+      for (const auto& sprite : sprites) {
+        const auto packed = sprite.contains("sliceIndex");
+        ids.push_back(add_string(sprite.value("id", "")));
+        slice_indices.push_back(packed ? sprite["sliceIndex"].get<int32_t>() : -1);
+        add_rect(rects, sprite.value("rect", nlohmann::json()));
+        add_rect(trimmed_rects, sprite.value("trimmedRect", nlohmann::json()));
+        pivots.push_back(packed ? sprite["pivot"]["x"].get<float>() : 0.0f);
+        pivots.push_back(packed ? sprite["pivot"]["y"].get<float>() : 0.0f);
+        rotated.push_back(packed && sprite["rotated"].get<bool>() ? 1 : 0);
+        vertex_ranges.push_back(static_cast<uint32_t>(vertices.size() / 2));
+        if (packed)
+          for (const auto& value : sprite["vertices"])
+            vertices.push_back(value.get<float>());
+        vertex_ranges.push_back(static_cast<uint32_t>(
+          vertices.size() / 2 - vertex_ranges.back()));
+      }
+
+      auto texture_filenames = std::vector<uint32_t>();
+      auto texture_slice_indices = std::vector<int32_t>();
+      auto texture_sizes = std::vector<int32_t>();
+      auto texture_layers = std::vector<int32_t>();
+      for (const auto& texture : textures) {
+        texture_filenames.push_back(add_string(texture["filename"].get<std::string>()));
+        texture_slice_indices.push_back(texture["sliceIndex"].get<int32_t>());
+        texture_sizes.push_back(texture["width"].get<int32_t>());
+        texture_sizes.push_back(texture["height"].get<int32_t>());
+        texture_layers.push_back(texture["layer"].get<int32_t>());
+      }
+
+      auto [displacements, slots] = build_perfect_hash(sprites);
+
+      const auto header_fields = 7 + 15;
+      m_data.resize(header_fields * sizeof(uint32_t));
+      auto header = std::vector<uint32_t>{
+        0x42525053, 1,
+        static_cast<uint32_t>(sprite_count),
+        static_cast<uint32_t>(texture_count),
+        static_cast<uint32_t>(slots.size()),
+        static_cast<uint32_t>(vertices.size() / 2),
+        static_cast<uint32_t>(m_strings.size()),
+      };
+      header.push_back(append(ids));
+      header.push_back(append(slice_indices));
+      header.push_back(append(rects));
+      header.push_back(append(trimmed_rects));
+      header.push_back(append(pivots));
+      header.push_back(append(rotated));
+      header.push_back(append(vertex_ranges));
+      header.push_back(append(vertices));
+      header.push_back(append(displacements));
+      header.push_back(append(slots));
+      header.push_back(append(texture_filenames));
+      header.push_back(append(texture_slice_indices));
+      header.push_back(append(texture_sizes));
+      header.push_back(append(texture_layers));
+      header.push_back(append(m_strings));
+      for (auto i = 0u; i < header.size(); ++i)
+        write_u32(i * sizeof(uint32_t), header[i]);
     }
 
-    auto slice_textures = std::vector<Texture>();    
-    std::copy_if(textures.begin(), textures.end(),
-      std::back_inserter(slice_textures),
-      [&](const Texture& texture) {
-        return (texture.slice->index == slice_index);
-      });
+    const std::vector<uint8_t>& data() const { return m_data; }
+
+  private:
+    // same as spright_hash in docs/spright_binary.h
+    static uint32_t hash(uint32_t seed, const std::string& key) {
+      auto hash = (seed ? seed : 2166136261u);
+      for (auto c : key) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+    // http://stevehanov.ca/blog/index.php?id=119
+    static std::pair<std::vector<int32_t>, std::vector<uint32_t>>
+        build_perfect_hash(const nlohmann::json& sprites) {
+      // first sprite with an id wins
+      auto keys = std::vector<std::pair<std::string, uint32_t>>();
+      auto unique = std::set<std::string>();
+      for (auto i = 0u; i < sprites.size(); ++i)
+        if (auto id = sprites[i].value("id", ""); unique.insert(id).second)
+          keys.emplace_back(std::move(id), i);
+
+      const auto size = static_cast<uint32_t>(keys.size());
+      auto buckets = std::vector<std::vector<size_t>>(size);
+      for (auto i = 0u; i < keys.size(); ++i)
+        buckets[hash(0, keys[i].first) % size].push_back(i);
+      std::stable_sort(buckets.begin(), buckets.end(),
+        [](const auto& a, const auto& b) { return a.size() > b.size(); });
+
+      auto displacements = std::vector<int32_t>(size);
+      auto slots = std::vector<uint32_t>(size, ~0u);
+      auto bucket = buckets.begin();
+      for (; bucket != buckets.end() && bucket->size() > 1; ++bucket) {
+        // find displacement which places all keys of bucket in free slots
+        for (auto d = 1u; ; ++d) {
+          auto placed = std::vector<uint32_t>();
+          for (const auto key : *bucket) {
+            const auto slot = hash(d, keys[key].first) % size;
+            if (slots[slot] != ~0u || 
+                std::find(placed.begin(), placed.end(), slot) != placed.end())
+              break;
+            placed.push_back(slot);
+          }
+          if (placed.size() == bucket->size()) {
+            for (auto i = 0u; i < placed.size(); ++i)
+              slots[placed[i]] = keys[(*bucket)[i]].second;
+            displacements[hash(0, keys[bucket->front()].first) % size] = to_int(d);
+            break;
+          }
+        }
+      }
+
+      // place keys of single buckets directly in remaining slots
+      auto free_slot = 0u;
+      for (; bucket != buckets.end() && !bucket->empty(); ++bucket) {
+        while (slots[free_slot] != ~0u)
+          ++free_slot;
+        const auto& [key, sprite_index] = keys[bucket->front()];
+        slots[free_slot] = sprite_index;
+        displacements[hash(0, key) % size] = -to_int(free_slot) - 1;
+      }
+      return { displacements, slots };
+    }
 
-    for (auto& texture : slice_textures)
-      texture.slice = &sole_slice;
+    uint32_t add_string(const std::string& string) {
+      const auto offset = static_cast<uint32_t>(m_strings.size());
+      m_strings.insert(m_strings.end(), string.begin(), string.end());
+      m_strings.push_back('\0');
+      return offset;
+    }
+
+    template<typename T>
+    uint32_t append(const std::vector<T>& values) {
+      const auto offset = static_cast<uint32_t>(m_data.size());
+      const auto size = values.size() * sizeof(T);
+      m_data.resize(offset + ((size + 3) / 4) * 4);
+      if constexpr (sizeof(T) == 1) {
+        if (size)
+          std::memcpy(&m_data[offset], values.data(), size);
+      }
+      else {
+        static_assert(sizeof(T) == sizeof(uint32_t));
+        // independent of host byte order
+        for (auto i = size_t{ }; i < values.size(); ++i) {
+          auto value = uint32_t{ };
+          std::memcpy(&value, &values[i], sizeof(value));
+          write_u32(offset + i * sizeof(value), value);
+        }
+      }
+      return offset;
+    }
+
+    void write_u32(size_t offset, uint32_t value) {
+      for (auto i = 0u; i < 4; ++i)
+        m_data[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    std::vector<char> m_strings;
+    std::vector<uint8_t> m_data;
+  };
+
+  void write_binary(std::ostream& os, const std::vector<uint8_t>& data) {
+    os.write(reinterpret_cast<const char*>(data.data()),
+      static_cast<std::streamsize>(data.size()));
+  }
+
+  void output_description(std::ostream& os, const Description& description,
+      const nlohmann::json& json, TemplateCache& templates) {
+    switch (description.format) {
+      case DescriptionFormat::cbor:
+        return write_binary(os, nlohmann::json::to_cbor(json));
+      case DescriptionFormat::msgpack:
+        return write_binary(os, nlohmann::json::to_msgpack(json));
+      case DescriptionFormat::ubjson:
+        return write_binary(os, nlohmann::json::to_ubjson(json));
+      case DescriptionFormat::binary:
+        return write_binary(os, BinaryDescriptionWriter(json).data());
+      case DescriptionFormat::undefined:
+      case DescriptionFormat::json:
+        break;
+    }
 
-    return { slice_sprites, slice_textures };
+    if (!description.template_filename.empty()) {
+      templates.render_to(os, description.template_filename, json);
+    }
+    else {
+      os << json.dump(1, '\t');
+    }
+  }
+
+  bool is_streamed_description(const Description& description) {
+    return (description.format == DescriptionFormat::json &&
+            description.template_filename.empty());
+  }
+
+  DescriptionFormat deduce_description_format(const Description& description) {
+    if (description.format != DescriptionFormat::undefined) {
+      if (description.format != DescriptionFormat::json &&
+          !description.template_filename.empty())
+        error("template is not supported by binary description format");
+      return description.format;
+    }
+    if (description.template_filename.empty()) {
+      const auto extension = to_lower(path_to_utf8(description.filename.extension()));
+      if (extension == ".cbor")
+        return DescriptionFormat::cbor;
+      if (extension == ".msgpack" || extension == ".mpk")
+        return DescriptionFormat::msgpack;
+      if (extension == ".ubj" || extension == ".ubjson")
+        return DescriptionFormat::ubjson;
+      if (extension == ".bin")
+        return DescriptionFormat::binary;
+    }
+    return DescriptionFormat::json;
   }
 } // namespace
 
@@ -387,6 +1034,7 @@ void complete_description_definitions(const Settings& settings,
   for (auto& description : descriptions) {
     replace_variables(description.template_filename, variables);
     resolve_template_filename(description.template_filename);
+    description.format = deduce_description_format(description);
   }
 }
 
@@ -395,7 +1043,8 @@ std::string dump_description(
     const std::vector<Sprite>& sprites, 
     const std::vector<Slice>& slices) {
   auto ss = std::ostringstream();
-  const auto json = get_json_description({ }, { }, sprites, slices, { }, { });
+  const auto json = get_json_description({ }, { }, 
+    get_description_scope(sprites, slices, { }), { });
   auto env = setup_inja_environment();
   env.render_to(ss, env.parse(template_source), json);
   return ss.str();
@@ -410,47 +1059,85 @@ void output_descriptions(
     const std::vector<Texture>& textures,
     const VariantMap& variables) {
 
-  auto json = std::optional<nlohmann::json>();
-
+  // parse templates and build what is shared by the descriptions upfront
+  auto templates = TemplateCache();
+  auto needs_scope = false;
+  auto needs_json = false;
+  auto needs_slice_scopes = false;
+  auto needs_slice_json = false;
   for (const auto& description : descriptions) {
     if (description.filename.empty())
       continue;
+    if (!description.template_filename.empty())
+      templates.parse(description.template_filename);
+    const auto streamed = is_streamed_description(description);
+    if (FilenameSequence(path_to_utf8(description.filename)).is_sequence()) {
+      needs_slice_scopes = true;
+      needs_slice_json |= !streamed;
+    }
+    else {
+      needs_scope = true;
+      needs_json |= !streamed;
+    }
+  }
+
+  const auto scope = (needs_scope ? 
+    get_description_scope(sprites, slices, textures) : DescriptionScope());
+  const auto json = (needs_json ? 
+    get_json_description(settings, inputs, scope, variables) : nlohmann::json());
+  const auto slice_scopes = (needs_slice_scopes ?
+    get_slice_description_scopes(sprites, slices, textures) : 
+    std::vector<DescriptionScope>());
+  auto slice_json = std::vector<nlohmann::json>(
+    needs_slice_json ? slice_scopes.size() : 0);
+  scheduler.for_each_parallel([&](size_t index) {
+    slice_json[index] = get_json_description(settings, 
+      inputs, slice_scopes[index], variables);
+  }, slice_json.size());
+
+  const auto write_description = [&](std::ostream& os, 
+      const Description& description, const DescriptionScope& scope,
+      const nlohmann::json& json) {
+    if (is_streamed_description(description))
+      return write_json_description(os, settings, inputs, scope, variables);
+    output_description(os, description, json, templates);
+  };
+
+  // render all descriptions concurrently, standard output is written in order
+  auto stdout_texts = std::vector<std::string>(descriptions.size());
+  scheduler.for_each_parallel([&](size_t description_index) {
+    const auto& description = descriptions[description_index];
+    if (description.filename.empty())
+      return;
 
     const auto filenames = FilenameSequence(path_to_utf8(description.filename));
     if (!filenames.is_sequence()) {
       // output all slices in one output description
-      if (!json.has_value())
-        json = get_json_description(settings,
-          inputs, sprites, slices, textures, variables);
-
+      auto ss = std::ostringstream();
+      write_description(ss, description, scope, json);
       if (description.filename.string() != "stdout") {
-        auto ss = std::ostringstream();
-        output_description(ss, description.template_filename, *json);
-        update_textfile(description.filename, ss.str());
+        if (!add_to_output_bundle(description.filename, ss.str()))
+          update_textfile(description.filename, ss.str());
       }
       else {
-        output_description(std::cout, description.template_filename, *json);
+        stdout_texts[description_index] = ss.str();
       }
     }
     else {
       // output each slice in separate output description
-      for (const auto& slice : slices) {
-        auto sole_slice = slice;
-        sole_slice.index = 0;
-
-        const auto [slice_sprites, slice_textures] =
-          filter_by_slice(slice.index, sole_slice, sprites, textures);
-        
-        const auto slice_json = get_json_description(settings,
-          inputs, slice_sprites, { sole_slice }, slice_textures, variables);
-
-        const auto filename = filenames.get_nth_filename(slice.index);
+      scheduler.for_each_parallel([&](size_t index) {
         auto ss = std::ostringstream();
-        output_description(ss, description.template_filename, slice_json);
-        update_textfile(filename, ss.str());
-      }
+        write_description(ss, description, slice_scopes[index],
+          needs_slice_json ? slice_json[index] : json);
+        const auto filename = filenames.get_nth_filename(slices[index].index);
+        if (!add_to_output_bundle(filename, ss.str()))
+          update_textfile(filename, ss.str());
+      }, slices.size());
     }
-  }
+  }, descriptions.size());
+
+  for (const auto& text : stdout_texts)
+    std::cout << text;
 }
 
 } // namespace
@@ -2,6 +2,11 @@
 #include "output.h"
 #include "globbing.h"
 #include "debug.h"
+#include "archive.h"
+#include "nlohmann/json.hpp"
+#include <charconv>
+#include <iomanip>
+#include <unordered_map>
 
 namespace spright {
 
@@ -108,11 +113,112 @@ namespace {
     return (texture.map_index >= 0);
   }
 
-  bool is_up_to_date(const Texture& texture) {
+  bool is_up_to_date(const Texture& texture, const Slice& slice) {
+    if (texture.up_to_date)
+      return true;
+
     // exists and is newer than input
-    return (texture.slice->last_source_written_time && 
+    return (slice.last_source_written_time && 
         try_get_last_write_time(texture.filename) > 
-        texture.slice->last_source_written_time);
+        slice.last_source_written_time);
+  }
+
+  bool is_up_to_date(const Texture& texture) {
+    return is_up_to_date(texture, *texture.slice);
+  }
+
+  void add_output_settings(Hasher& hasher, const Output& output) {
+    hasher.add_value(output.alpha);
+    hasher.add_value(output.alpha_color);
+    hasher.add_value(output.scale);
+    hasher.add_value(output.scale_filter);
+    hasher.add_value(output.compression);
+    hasher.add_value(output.mipmaps);
+    hasher.add_value(output.mipmap_levels);
+    hasher.add_value(output.mipmap_bleed_free_level);
+    hasher.add_value(output.array);
+    hasher.add_value(output.palette_colors);
+    hasher.add_value(output.debug);
+  }
+
+  // compares the hash of the processed images with the one of the written file
+  bool is_output_unchanged(Texture& texture, 
+      const std::vector<const Image*>& images) {
+    if (!texture.hashes)
+      return false;
+
+    auto hasher = Hasher();
+    hasher.add_string(path_to_utf8(texture.filename));
+    add_output_settings(hasher, *texture.output);
+    hasher.add_value(images.size());
+    for (const auto* image : images) {
+      hasher.add_value(image->width());
+      hasher.add_value(image->height());
+      hasher.add(image->data().data(), image->data().size());
+    }
+    texture.hashes->image = hasher.value();
+
+    auto error = std::error_code{ };
+    return (texture.written_hashes &&
+      texture.written_hashes->image == texture.hashes->image &&
+      std::filesystem::exists(texture.filename, error));
+  }
+
+  Rect get_sprite_output_bounds(const Sprite& sprite) {
+    auto rect = sprite.trimmed_rect;
+    if (sprite.rotated)
+      std::swap(rect.w, rect.h);
+    return expand(rect, sprite.extrude.count);
+  }
+
+  bool can_recompose_partially(const Texture& texture) {
+    const auto& output = *texture.output;
+    if (texture.up_to_date || !texture.hashes || !texture.written_hashes ||
+        texture.hashes->layout != texture.written_hashes->layout ||
+        texture.hashes->sprites.size() != texture.written_hashes->sprites.size())
+      return false;
+
+    // bleeding is not local, other outputs can not be restored from the file
+    const auto extension = to_lower(path_to_utf8(texture.filename.extension()));
+    return (output.alpha != Alpha::bleed && output.scale == 1.0 &&
+      !output.debug && !output.palette_colors &&
+      (extension == ".png" || extension == ".qoi" || extension == ".tga"));
+  }
+
+  // loads the written texture and recomposes the rects of the changed sprites
+  Image recompose_slice_image(const Texture& texture) try {
+    const auto& slice = *texture.slice;
+    auto dirty_rects = std::vector<Rect>();
+    for (auto i = 0u; i < slice.sprites.size(); ++i)
+      if (texture.hashes->sprites[i] != texture.written_hashes->sprites[i])
+        dirty_rects.push_back(intersect(
+          get_sprite_output_bounds(slice.sprites[i]), 
+          { 0, 0, slice.width, slice.height }));
+
+    auto image = load_image(texture.filename);
+    if (image.width() != slice.width || image.height() != slice.height)
+      return { };
+
+    // compose all sprites which affect the dirty rects in original order
+    auto composed = Image(slice.width, slice.height, RGBA{ });
+    for (const auto& sprite : slice.sprites) {
+      const auto bounds = get_sprite_output_bounds(sprite);
+      if (std::any_of(dirty_rects.begin(), dirty_rects.end(),
+            [&](const Rect& rect) { return overlapping(rect, bounds); }))
+        copy_sprite(composed, sprite, texture.map_index);
+    }
+
+    for (const auto& rect : dirty_rects) {
+      if (empty(rect))
+        continue;
+      auto region = clone_image(composed, rect);
+      process_alpha(region, *texture.output);
+      copy_rect(region, region.bounds(), image, rect.x, rect.y);
+    }
+    return image;
+  }
+  catch (const std::exception&) {
+    return { };
   }
 
   void process_texture_image(const Texture& texture, Image& image) {
@@ -123,28 +229,39 @@ namespace {
       image = resize_image(image, output.scale, output.scale_filter);
   }
 
-  bool output_image(const Texture& texture) {
+  bool output_image(Texture& texture) {
     // do not return before check if there is a map for slice
     if (!is_map(texture) && is_up_to_date(texture))
       return true;
 
-    auto image = get_slice_image(*texture.slice, texture.map_index);
-    if (!image)
-      return false;
-
-    if (is_map(texture) && is_up_to_date(texture))
-      return true;
-    
-    process_texture_image(texture, image);
+    auto image = (can_recompose_partially(texture) ? 
+      recompose_slice_image(texture) : Image());
+    if (!image) {
+      image = get_slice_image(*texture.slice, texture.map_index);
+      if (!image)
+        return false;
+
+      if (is_map(texture) && is_up_to_date(texture))
+        return true;
+      
+      process_texture_image(texture, image);
+    }
 
     if (texture.output->debug)
       draw_debug_info(image, *texture.slice, texture.output->scale);
 
-    save_image(image, texture.filename);
+    if (is_output_unchanged(texture, { &image }))
+      return true;
+
+    const auto& output = *texture.output;
+    const auto mipmaps = (output.mipmaps ? generate_mipmaps(image, 
+      output.mipmap_levels, output.scale_filter) : std::vector<Image>());
+    save_image(image, texture.filename, output.compression, mipmaps, 
+      output.palette_colors);
     return true;
   }
 
-  bool output_animation(const Texture& texture) {
+  bool output_animation(Texture& texture) {
     // do not return before check if there is a map for slice
     if (!is_map(texture) && is_up_to_date(texture))
       return true;
@@ -166,19 +283,264 @@ namespace {
             texture.slice->sprites[to_unsigned(frame.index)], texture.output->scale);
       });
 
+    auto frames = std::vector<const Image*>();
+    for (const auto& frame : animation.frames)
+      frames.push_back(&frame.image);
+    if (is_output_unchanged(texture, frames))
+      return true;
+
     if (texture.output->alpha == Alpha::colorkey)
       animation.color_key = texture.output->alpha_color;
+    animation.max_colors = texture.output->palette_colors;
     save_animation(animation, texture.filename);
     return true;
   }
 
-  bool output_texture(const Texture& texture) {
+  bool output_image_array(Texture& texture) {
+    // the first layer's texture writes the whole array
+    if (texture.layer_index != 0)
+      return true;
+
+    const auto& layer_slices = *texture.layer_slices;
+    if (std::all_of(layer_slices.begin(), layer_slices.end(),
+          [&](const Slice* slice) { return is_up_to_date(texture, *slice); }))
+      return true;
+
+    auto layers = std::vector<Image>();
+    for (const auto* slice : layer_slices) {
+      if (slice->layered) {
+        auto animation = get_slice_animation(*slice, texture.map_index);
+        for (auto& frame : animation.frames)
+          layers.push_back(std::move(frame.image));
+      }
+      else {
+        layers.push_back(get_slice_image(*slice, texture.map_index));
+      }
+    }
+    if (layers.empty() || !std::all_of(layers.begin(), layers.end(), 
+          [](const Image& image) { return static_cast<bool>(image); }))
+      return false;
+
+    // layers need to have the same size
+    auto size = Size{ };
+    for (const auto& image : layers) {
+      size.x = std::max(size.x, image.width());
+      size.y = std::max(size.y, image.height());
+    }
+    scheduler.for_each_parallel([&](size_t index) {
+      auto& image = layers[index];
+      if (image.width() != size.x || image.height() != size.y) {
+        auto extended = Image(size.x, size.y, RGBA{ });
+        copy_rect(image, image.bounds(), extended, 0, 0);
+        image = std::move(extended);
+      }
+      process_texture_image(texture, image);
+    }, layers.size());
+
+    auto images = std::vector<const Image*>();
+    for (const auto& image : layers)
+      images.push_back(&image);
+    if (is_output_unchanged(texture, images))
+      return true;
+
+    const auto& output = *texture.output;
+    auto layer_mipmaps = std::vector<std::vector<Image>>(layers.size());
+    if (output.mipmaps)
+      scheduler.for_each_parallel([&](size_t index) {
+        layer_mipmaps[index] = generate_mipmaps(layers[index], 
+          output.mipmap_levels, output.scale_filter);
+      }, layers.size());
+
+    save_image_array(layers, texture.filename, 
+      output.compression, layer_mipmaps);
+    return true;
+  }
+
+  bool output_texture(Texture& texture) {
+    if (texture.output->array)
+      return output_image_array(texture);
     if (!texture.slice->layered)
       return output_image(texture);
     return output_animation(texture);
   }
+
+  // increase when the output for the same input changes
+  const auto manifest_version = 1;
+
+  using TextureManifest = std::map<std::string, TextureHashes, std::less<>>;
+
+  std::vector<const Slice*> get_texture_slices(const Texture& texture) {
+    if (texture.layer_slices)
+      return *texture.layer_slices;
+    return { texture.slice };
+  }
+
+  // the array's first layer texture writes the file
+  bool writes_file(const Texture& texture) {
+    return (texture.layer_index == 0);
+  }
+
+  uint64_t get_sprite_hash(const Sprite& sprite, int map_index) {
+    const auto source = get_source(sprite, map_index);
+    if (!source)
+      return { };
+    const auto rect = intersect(sprite.trimmed_source_rect, source->bounds());
+    const auto source_rgba = source->view<RGBA>();
+    auto hasher = Hasher();
+    hasher.add_value(rect);
+    for (auto y = rect.y0(); y < rect.y1(); ++y)
+      hasher.add(source_rgba.values_at(rect.x, y), 
+        to_unsigned(rect.w) * sizeof(RGBA));
+    return hasher.value();
+  }
+
+  uint64_t get_layout_hash(const Texture& texture) {
+    auto hasher = Hasher();
+    hasher.add_value(manifest_version);
+    hasher.add_string(path_to_utf8(texture.filename));
+    hasher.add_value(texture.map_index);
+    hasher.add_value(texture.layer_index);
+    add_output_settings(hasher, *texture.output);
+
+    for (const auto* slice : get_texture_slices(texture)) {
+      hasher.add_value(slice->width);
+      hasher.add_value(slice->height);
+      hasher.add_value(slice->layered);
+      hasher.add_value(slice->sprites.size());
+      for (const auto& sprite : slice->sprites) {
+        hasher.add_value(sprite.source_rect);
+        hasher.add_value(sprite.trimmed_source_rect);
+        hasher.add_value(sprite.rect);
+        hasher.add_value(sprite.trimmed_rect);
+        hasher.add_value(sprite.pivot.x);
+        hasher.add_value(sprite.pivot.y);
+        hasher.add_value(sprite.rotated);
+        hasher.add_value(sprite.extrude);
+        hasher.add_value(sprite.vertices.size());
+        hasher.add(sprite.vertices.data(), sprite.vertices.size() * sizeof(PointF));
+      }
+    }
+    return hasher.value();
+  }
+
+  TextureHashes get_texture_hashes(const Texture& texture) {
+    auto hashes = TextureHashes();
+    hashes.layout = get_layout_hash(texture);
+    for (const auto* slice : get_texture_slices(texture))
+      for (const auto& sprite : slice->sprites)
+        hashes.sprites.push_back(get_sprite_hash(sprite, texture.map_index));
+
+    auto hasher = Hasher();
+    hasher.add_value(hashes.layout);
+    hasher.add(hashes.sprites.data(), hashes.sprites.size() * sizeof(uint64_t));
+    hashes.input = hasher.value();
+    return hashes;
+  }
+
+  std::string to_hex(uint64_t value) {
+    auto ss = std::ostringstream();
+    ss << std::hex << std::setfill('0') << std::setw(16) << value;
+    return ss.str();
+  }
+
+  uint64_t from_hex(const nlohmann::json& json) {
+    const auto string = json.get<std::string>();
+    auto value = uint64_t{ };
+    std::from_chars(string.data(), string.data() + string.size(), value, 16);
+    return value;
+  }
+
+  nlohmann::json read_manifest(const std::filesystem::path& filename) {
+    auto error = std::error_code{ };
+    if (!std::filesystem::exists(filename, error))
+      return { };
+    try {
+      return nlohmann::json::parse(read_textfile(filename));
+    }
+    catch (const std::exception&) {
+      return { };
+    }
+  }
+
+  TextureManifest read_texture_manifest(const std::filesystem::path& filename) {
+    auto manifest = TextureManifest();
+
+    // ignore invalid manifest
+    try {
+      const auto json = read_manifest(filename);
+      if (json.is_null())
+        return manifest;
+      for (const auto& json_texture : json.at("textures")) {
+        auto& hashes = manifest[json_texture.at("filename").get<std::string>()];
+        hashes.input = from_hex(json_texture.at("input"));
+        hashes.layout = from_hex(json_texture.at("layout"));
+        hashes.image = from_hex(json_texture.at("image"));
+        for (const auto& json_sprite : json_texture.at("sprites"))
+          hashes.sprites.push_back(from_hex(json_sprite));
+      }
+    }
+    catch (const std::exception&) {
+      manifest.clear();
+    }
+    return manifest;
+  }
+
+  nlohmann::json get_json_packing_layout(const PackingLayout& layout) {
+    auto json_sheets = nlohmann::json::array();
+    for (const auto& [sheet_id, sheet_layout] : layout) {
+      auto& json_sheet = json_sheets.emplace_back();
+      json_sheet["id"] = sheet_id;
+      auto& json_sprites = json_sheet["sprites"];
+      json_sprites = nlohmann::json::array();
+      for (const auto& [key, packed] : sheet_layout) {
+        auto& json_sprite = json_sprites.emplace_back();
+        json_sprite["key"] = key;
+        json_sprite["slice"] = packed.slice_index;
+        json_sprite["rect"] = { packed.rect.x, packed.rect.y, 
+          packed.rect.w, packed.rect.h };
+        json_sprite["rotated"] = packed.rotated;
+      }
+    }
+    return json_sheets;
+  }
+
+  nlohmann::json get_json_trim_cache(const TrimCache& trim_cache) {
+    auto json_trims = nlohmann::json::array();
+    for (const auto& [key, result] : trim_cache) {
+      auto& json_trim = json_trims.emplace_back();
+      json_trim["key"] = to_hex(key);
+      const auto& rect = result.trimmed_rect;
+      json_trim["rect"] = { rect.x, rect.y, rect.w, rect.h };
+      auto& json_vertices = json_trim["vertices"];
+      json_vertices = nlohmann::json::array();
+      for (const auto& vertex : result.vertices) {
+        json_vertices.push_back(vertex.x);
+        json_vertices.push_back(vertex.y);
+      }
+    }
+    return json_trims;
+  }
 } // namespace
 
+Size get_texture_size(const Texture& texture) {
+  auto size = Size{ texture.slice->width, texture.slice->height };
+  if (texture.layer_slices)
+    for (const auto* slice : *texture.layer_slices) {
+      size.x = std::max(size.x, slice->width);
+      size.y = std::max(size.y, slice->height);
+    }
+  const auto scale = texture.output->scale;
+  return { to_int(size.x * scale), to_int(size.y * scale) };
+}
+
+int get_texture_layer_count(const Texture& texture) {
+  auto count = 0;
+  if (texture.layer_slices)
+    for (const auto* slice : *texture.layer_slices)
+      count += (slice->layered ? to_int(slice->sprites.size()) : 1);
+  return std::max(count, 1);
+}
+
 Image get_slice_image(const Slice& slice, int map_index) {
   auto target = Image(slice.width, slice.height, RGBA{ });
 
@@ -206,19 +568,43 @@ Animation get_slice_animation(const Slice& slice, int map_index) {
 
 std::vector<Texture> get_textures(const Settings& settings,
     const std::vector<Slice>& slices) {
+  // all slices of an array output are layers of a single file
+  auto sheet_slices = std::map<const Sheet*, std::shared_ptr<std::vector<const Slice*>>>();
+  auto sheet_layer_counts = std::map<const Sheet*, int>();
+  auto slice_layer_indices = std::vector<int>();
+  for (const auto& slice : slices) {
+    auto& sheet_slice_list = sheet_slices[slice.sheet.get()];
+    if (!sheet_slice_list)
+      sheet_slice_list = std::make_shared<std::vector<const Slice*>>();
+    sheet_slice_list->push_back(&slice);
+    auto& layer_count = sheet_layer_counts[slice.sheet.get()];
+    slice_layer_indices.push_back(layer_count);
+    layer_count += (slice.layered ? to_int(slice.sprites.size()) : 1);
+  }
+
   auto textures = std::vector<Texture>();
-  for (const auto& slice : slices)
+  for (auto i = size_t{ }; i < slices.size(); ++i) {
+    const auto& slice = slices[i];
     for (const auto& output : slice.sheet->outputs) {
+      auto layer_slices = std::shared_ptr<const std::vector<const Slice*>>();
+      auto layer_index = 0;
+      if (output->array) {
+        layer_slices = sheet_slices[slice.sheet.get()];
+        layer_index = slice_layer_indices[i];
+      }
       const auto filename = settings.output_path / utf8_to_path(
-        output->filename.get_nth_filename(slice.sheet_index));
-      textures.push_back({ &slice, output.get(), path_to_utf8(filename), -1 });
+        output->filename.get_nth_filename(output->array ? 0 : slice.sheet_index));
+      textures.push_back({ &slice, output.get(), path_to_utf8(filename), -1,
+        layer_slices, layer_index });
 
-      auto i = 0;
+      auto map_index = 0;
       for (const auto& map_suffix : output->map_suffixes)
         textures.push_back({ &slice, output.get(), 
           path_to_utf8(replace_suffix(filename,
-            output->default_map_suffix, map_suffix)), i++ });
+            output->default_map_suffix, map_suffix)), map_index++,
+          layer_slices, layer_index });
     }
+  }
   return textures;
 }
 
@@ -230,4 +616,117 @@ void output_textures(std::vector<Texture>& textures) {
     });
 }
 
+void apply_texture_manifest(const Settings& settings, std::vector<Texture>& textures) {
+  scheduler.for_each_parallel(textures,
+    [&](Texture& texture) {
+      texture.hashes = get_texture_hashes(texture);
+    });
+
+  // bundled textures are always written, only their hashes are stored
+  if (settings.mode == Mode::rebuild || is_output_bundle_open())
+    return;
+
+  auto manifest = read_texture_manifest(settings.manifest_file);
+  for (auto& texture : textures) {
+    const auto it = manifest.find(path_to_utf8(texture.filename));
+    if (it == manifest.end() || !writes_file(texture))
+      continue;
+
+    auto error = std::error_code{ };
+    texture.written_hashes = std::move(it->second);
+    texture.up_to_date = (texture.written_hashes->input == texture.hashes->input &&
+      std::filesystem::exists(texture.filename, error));
+    if (texture.up_to_date)
+      texture.hashes->image = texture.written_hashes->image;
+  }
+}
+
+PackingLayout read_packing_layout(const Settings& settings) {
+  auto layout = PackingLayout();
+  if (settings.manifest_file.empty() || settings.mode == Mode::rebuild)
+    return layout;
+
+  // ignore invalid layout
+  try {
+    const auto json = read_manifest(settings.manifest_file);
+    if (json.is_null() || !json.contains("sheets"))
+      return layout;
+    for (const auto& json_sheet : json.at("sheets")) {
+      auto& sheet_layout = layout[json_sheet.at("id").get<std::string>()];
+      for (const auto& json_sprite : json_sheet.at("sprites")) {
+        const auto& json_rect = json_sprite.at("rect");
+        sheet_layout[json_sprite.at("key").get<std::string>()] = {
+          json_sprite.at("slice").get<int>(),
+          Rect{ json_rect.at(0).get<int>(), json_rect.at(1).get<int>(),
+                json_rect.at(2).get<int>(), json_rect.at(3).get<int>() },
+          json_sprite.at("rotated").get<bool>(),
+        };
+      }
+    }
+  }
+  catch (const std::exception&) {
+    layout.clear();
+  }
+  return layout;
+}
+
+TrimCache read_trim_cache(const Settings& settings) {
+  auto trim_cache = TrimCache();
+  if (settings.manifest_file.empty() || settings.mode == Mode::rebuild)
+    return trim_cache;
+
+  // ignore invalid cache
+  try {
+    const auto json = read_manifest(settings.manifest_file);
+    if (json.is_null() || !json.contains("trims"))
+      return trim_cache;
+    for (const auto& json_trim : json.at("trims")) {
+      auto& result = trim_cache[from_hex(json_trim.at("key"))];
+      const auto& json_rect = json_trim.at("rect");
+      result.trimmed_rect = { json_rect.at(0).get<int>(), json_rect.at(1).get<int>(),
+                              json_rect.at(2).get<int>(), json_rect.at(3).get<int>() };
+      const auto& json_vertices = json_trim.at("vertices");
+      for (auto i = size_t{ }; i + 1 < json_vertices.size(); i += 2)
+        result.vertices.push_back({ json_vertices.at(i).get<real>(),
+                                    json_vertices.at(i + 1).get<real>() });
+    }
+  }
+  catch (const std::exception&) {
+    trim_cache.clear();
+  }
+  return trim_cache;
+}
+
+void write_texture_manifest(const Settings& settings,
+    const std::vector<Sprite>& sprites, const std::vector<Texture>& textures,
+    const TrimCache& trim_cache) {
+  auto sorted = std::vector<const Texture*>();
+  for (const auto& texture : textures)
+    if (writes_file(texture) && !texture.filename.empty() && texture.hashes)
+      sorted.push_back(&texture);
+  std::sort(sorted.begin(), sorted.end(), 
+    [](const Texture* a, const Texture* b) { return a->filename < b->filename; });
+
+  auto json_textures = nlohmann::json::array();
+  for (const auto* texture : sorted) {
+    const auto& hashes = *texture->hashes;
+    auto& json_texture = json_textures.emplace_back();
+    json_texture["filename"] = path_to_utf8(texture->filename);
+    json_texture["input"] = to_hex(hashes.input);
+    json_texture["layout"] = to_hex(hashes.layout);
+    json_texture["image"] = to_hex(hashes.image);
+    auto& json_sprites = json_texture["sprites"];
+    json_sprites = nlohmann::json::array();
+    for (const auto hash : hashes.sprites)
+      json_sprites.push_back(to_hex(hash));
+  }
+  auto json = nlohmann::json::object();
+  json["textures"] = std::move(json_textures);
+  if (auto layout = get_packing_layout(sprites); !layout.empty())
+    json["sheets"] = get_json_packing_layout(layout);
+  if (!trim_cache.empty())
+    json["trims"] = get_json_trim_cache(trim_cache);
+  update_textfile(settings.manifest_file, json.dump(1, '\t'));
+}
+
 } // namespace
@@ -1,11 +1,236 @@
 
 #include "packing.h"
 #include "rect_pack/rect_pack.h"
+#include <set>
 
 namespace spright {
 
+namespace {
+  // extent of slices without maximum size, when placing incrementally
+  const auto unlimited_size = (1 << 24);
+
+  // keeps the maximal free rectangles of a slice
+  class MaxRectsBin {
+  public:
+    explicit MaxRectsBin(const Rect& rect)
+      : m_free_rects{ rect } {
+    }
+
+    bool is_free(const Rect& rect) const {
+      return std::any_of(m_free_rects.begin(), m_free_rects.end(),
+        [&](const Rect& free_rect) { return containing(free_rect, rect); });
+    }
+
+    // prefers the position which grows the used area the least,
+    // then the top-left most
+    std::optional<Point> find_position(const Size& size) const {
+      auto best = std::optional<Point>();
+      auto best_score = std::tuple<int64_t, int, int>();
+      for (const auto& free_rect : m_free_rects)
+        if (free_rect.w >= size.x && free_rect.h >= size.y) {
+          const auto score = std::make_tuple(
+            int64_t{ std::max(m_extent.x, free_rect.x + size.x) } *
+                     std::max(m_extent.y, free_rect.y + size.y),
+            free_rect.y, free_rect.x);
+          if (!best || score < best_score) {
+            best = free_rect.xy();
+            best_score = score;
+          }
+        }
+      return best;
+    }
+
+    void occupy(const Rect& rect) {
+      m_extent.x = std::max(m_extent.x, rect.x1());
+      m_extent.y = std::max(m_extent.y, rect.y1());
+
+      auto split_rects = std::vector<Rect>();
+      for (auto it = m_free_rects.begin(); it != m_free_rects.end(); ) {
+        if (!overlapping(*it, rect)) {
+          ++it;
+          continue;
+        }
+        const auto free_rect = *it;
+        it = m_free_rects.erase(it);
+        if (rect.x0() > free_rect.x0())
+          split_rects.push_back({ free_rect.x, free_rect.y,
+            rect.x0() - free_rect.x0(), free_rect.h });
+        if (rect.x1() < free_rect.x1())
+          split_rects.push_back({ rect.x1(), free_rect.y,
+            free_rect.x1() - rect.x1(), free_rect.h });
+        if (rect.y0() > free_rect.y0())
+          split_rects.push_back({ free_rect.x, free_rect.y,
+            free_rect.w, rect.y0() - free_rect.y0() });
+        if (rect.y1() < free_rect.y1())
+          split_rects.push_back({ free_rect.x, rect.y1(),
+            free_rect.w, free_rect.y1() - rect.y1() });
+      }
+      for (const auto& split_rect : split_rects)
+        add_free_rect(split_rect);
+    }
+
+  private:
+    void add_free_rect(const Rect& rect) {
+      for (const auto& free_rect : m_free_rects)
+        if (containing(free_rect, rect))
+          return;
+      m_free_rects.erase(std::remove_if(m_free_rects.begin(), m_free_rects.end(),
+        [&](const Rect& free_rect) { return containing(rect, free_rect); }),
+        m_free_rects.end());
+      m_free_rects.push_back(rect);
+    }
+
+    std::vector<Rect> m_free_rects;
+    Size m_extent{ };
+  };
+
+  Size get_packed_size(const Sprite& sprite, bool rotated) {
+    return (rotated ? Size{ sprite.bounds.y, sprite.bounds.x } : sprite.bounds);
+  }
+
+  std::vector<PackedSprite> get_packed_sprites(const SpriteSpan& sprites,
+      const std::vector<rect_pack::Sheet>& pack_sheets) {
+    auto packed_sprites = std::vector<PackedSprite>(sprites.size(),
+      PackedSprite{ -1 });
+    auto slice_index = 0;
+    for (const auto& pack_sheet : pack_sheets) {
+      for (const auto& pack_rect : pack_sheet.rects) {
+        const auto index = to_unsigned(pack_rect.id);
+        const auto size = get_packed_size(sprites[index], pack_rect.rotated);
+        packed_sprites[index] = { slice_index,
+          Rect{ pack_rect.x, pack_rect.y, size.x, size.y }, pack_rect.rotated };
+      }
+      ++slice_index;
+    }
+    return packed_sprites;
+  }
+
+  // sum of the slices' areas, before rounding the sizes
+  int64_t get_packed_area(const Sheet& sheet,
+      const std::vector<PackedSprite>& packed_sprites) {
+    auto extents = std::vector<Size>();
+    for (const auto& packed : packed_sprites) {
+      if (packed.slice_index < 0)
+        continue;
+      const auto index = to_unsigned(packed.slice_index);
+      if (index >= extents.size())
+        extents.resize(index + 1);
+      extents[index].x = std::max(extents[index].x, packed.rect.x1());
+      extents[index].y = std::max(extents[index].y, packed.rect.y1());
+    }
+    auto area = int64_t{ };
+    for (const auto& extent : extents)
+      area += int64_t{ extent.x + sheet.border_padding } *
+                      (extent.y + sheet.border_padding);
+    return area;
+  }
+
+  // keeps the sprites of the previous layout in place and
+  // puts new and resized sprites into the remaining free space
+  std::optional<std::vector<PackedSprite>> pack_incremental(
+      const Sheet& sheet, const SpriteSpan& sprites,
+      const SheetLayout& previous_layout) {
+    const auto [max_width, max_height] = get_slice_max_size(sheet);
+    const auto max_slice_count = get_max_slice_count(sheet);
+    const auto padding = sheet.shape_padding;
+    const auto border = sheet.border_padding;
+    const auto slice_rect = Rect{ border, border,
+      std::min(max_width, unlimited_size) - 2 * border + padding,
+      std::min(max_height, unlimited_size) - 2 * border + padding };
+    const auto padded = [&](const Point& position, const Size& size) {
+      return Rect{ position.x, position.y, size.x + padding, size.y + padding };
+    };
+
+    auto slices = std::vector<MaxRectsBin>();
+    auto packed_sprites = std::vector<PackedSprite>(sprites.size(),
+      PackedSprite{ -1 });
+    auto keys = std::set<std::string>();
+    auto new_sprites = std::vector<size_t>();
+    for (auto i = size_t{ }; i < sprites.size(); ++i) {
+      const auto& sprite = sprites[i];
+      auto key = get_sprite_layout_key(sprite);
+      const auto it = previous_layout.find(key);
+      const auto keep = [&]() {
+        if (it == previous_layout.end() || !keys.insert(std::move(key)).second)
+          return false;
+        const auto& packed = it->second;
+        if (!(packed.rect.size() == get_packed_size(sprite, packed.rotated)) ||
+            (packed.rotated && !sheet.allow_rotate) ||
+            packed.slice_index < 0 ||
+            packed.slice_index >= max_slice_count ||
+            packed.slice_index >= to_int(sprites.size()))
+          return false;
+        const auto rect = padded(packed.rect.xy(), packed.rect.size());
+        if (to_unsigned(packed.slice_index) >= slices.size())
+          slices.resize(to_unsigned(packed.slice_index) + 1,
+            MaxRectsBin(slice_rect));
+        auto& slice = slices[to_unsigned(packed.slice_index)];
+        if (!slice.is_free(rect))
+          return false;
+        slice.occupy(rect);
+        packed_sprites[i] = packed;
+        return true;
+      };
+      if (!keep())
+        new_sprites.push_back(i);
+    }
+
+    // place largest new sprites first
+    std::stable_sort(new_sprites.begin(), new_sprites.end(),
+      [&](size_t a, size_t b) {
+        const auto& sa = sprites[a].bounds;
+        const auto& sb = sprites[b].bounds;
+        return std::make_pair(std::max(sa.x, sa.y), sa.x * sa.y) >
+               std::make_pair(std::max(sb.x, sb.y), sb.x * sb.y);
+      });
+
+    const auto try_place = [&](size_t index, int slice_index) {
+      auto& slice = slices[to_unsigned(slice_index)];
+      for (auto rotated : { false, true }) {
+        if (rotated && !sheet.allow_rotate)
+          break;
+        const auto size = get_packed_size(sprites[index], rotated);
+        if (const auto position = slice.find_position(padded({ }, size).size())) {
+          slice.occupy(padded(*position, size));
+          packed_sprites[index] = { slice_index,
+            Rect{ position->x, position->y, size.x, size.y }, rotated };
+          return true;
+        }
+      }
+      return false;
+    };
+
+    for (const auto index : new_sprites) {
+      auto placed = false;
+      for (auto i = 0; i < to_int(slices.size()) && !placed; ++i)
+        placed = try_place(index, i);
+
+      if (!placed && to_int(slices.size()) < max_slice_count) {
+        slices.emplace_back(slice_rect);
+        placed = try_place(index, to_int(slices.size()) - 1);
+      }
+      if (!placed)
+        return std::nullopt;
+    }
+
+    // remove slices which became empty
+    auto slice_indices = std::vector<int>(slices.size(), -1);
+    for (const auto& packed : packed_sprites)
+      slice_indices[to_unsigned(packed.slice_index)] = 0;
+    auto slice_count = 0;
+    for (auto& slice_index : slice_indices)
+      if (slice_index == 0)
+        slice_index = slice_count++;
+    for (auto& packed : packed_sprites)
+      packed.slice_index = slice_indices[to_unsigned(packed.slice_index)];
+
+    return packed_sprites;
+  }
+} // namespace
+
 void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
-    std::vector<Slice>& slices, bool fast) {
+    std::vector<Slice>& slices, bool fast,
+    const SheetLayout* previous_layout) {
   const auto& sheet = *sheet_ptr;
 
   // pack rects
@@ -35,18 +260,29 @@ void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
       max_height,
     },
     std::move(pack_sizes));
+  auto packed_sprites = get_packed_sprites(sprites, pack_sheets);
+
+  // keep previous layout, unless a full repack saves enough space
+  if (previous_layout)
+    if (auto incremental = pack_incremental(sheet, sprites, *previous_layout)) {
+      const auto area = get_packed_area(sheet, *incremental);
+      const auto repacked_area = get_packed_area(sheet, packed_sprites);
+      const auto fragmentation = (area ?
+        1.0 - static_cast<real>(repacked_area) / static_cast<real>(area) : 0.0);
+      if (fragmentation <= sheet.max_fragmentation)
+        packed_sprites = std::move(*incremental);
+    }
 
   // update sprite rects
-  auto slice_index = 0;
-  for (const auto& pack_sheet : pack_sheets) {
-    for (const auto& pack_rect : pack_sheet.rects) {
-      auto& sprite = sprites[to_unsigned(pack_rect.id)];
-      sprite.rotated = pack_rect.rotated;
-      sprite.slice_index = slice_index;
-      sprite.trimmed_rect.x = pack_rect.x;
-      sprite.trimmed_rect.y = pack_rect.y;
-    }
-    ++slice_index;
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    auto& sprite = sprites[i];
+    const auto& packed = packed_sprites[i];
+    if (packed.slice_index < 0)
+      continue;
+    sprite.rotated = packed.rotated;
+    sprite.slice_index = packed.slice_index;
+    sprite.trimmed_rect.x = packed.rect.x;
+    sprite.trimmed_rect.y = packed.rect.y;
   }
   create_slices_from_indices(sheet_ptr, sprites, slices);
 }
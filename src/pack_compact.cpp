@@ -12,7 +12,161 @@ namespace {
   struct FreeBody { void operator()(cpBody* body) { cpBodyFree(body); } };
   using BodyPtr = std::unique_ptr<cpBody, FreeBody>;
 
+  // horizontal range of pixels [x0, x1)
+  struct Span {
+    int x0;
+    int x1;
+  };
+
+  // pixels a sprite covers relative to its bounds, one span per row
+  // starting at row top, extruded pixels can lie left of or above the bounds
+  struct SpriteMask {
+    int left{ };
+    int top{ };
+    int width{ };
+    std::vector<Span> rows;
+
+    int bottom() const { return top + to_int(rows.size()); }
+  };
+
+  SpriteMask get_sprite_mask(const Sprite& sprite) {
+    const auto [w, h] = sprite.trimmed_source_rect.size();
+    const auto extrude = sprite.extrude.count;
+    auto mask = SpriteMask{ };
+    mask.left = std::min(sprite.align.x - extrude, 0);
+    mask.top = std::min(sprite.align.y - extrude, 0);
+    const auto add_pixel = [&](int x, int y) {
+      x += sprite.align.x;
+      y += sprite.align.y - mask.top;
+      if (to_unsigned(y) >= mask.rows.size())
+        mask.rows.resize(to_unsigned(y) + 1, Span{
+          std::numeric_limits<int>::max(), std::numeric_limits<int>::min() });
+      auto& span = mask.rows[to_unsigned(y)];
+      span.x0 = std::min(span.x0, x);
+      span.x1 = std::max(span.x1, x + 1);
+      mask.width = std::max(mask.width, span.x1);
+    };
+
+    // same pixels as copied to the output
+    for (auto y = -extrude; y < h + extrude; ++y)
+      for (auto x = -extrude; x < w + extrude; ++x)
+        if (extrude || point_in_polygon(x + 0.5, y + 0.5, sprite.vertices)) {
+          if (sprite.rotated)
+            add_pixel(h - 1 - y, x);
+          else
+            add_pixel(x, y);
+        }
+    return mask;
+  }
+
+  // occupied pixels of a slice, as sorted disjoint spans per row
+  class Occupancy {
+  public:
+    explicit Occupancy(int height)
+      : m_rows(to_unsigned(height)) {
+    }
+
+    // returns the x, up to which the mask collides when placed at x, y
+    std::optional<int> get_collision_end(const SpriteMask& mask, int x, int y) const {
+      auto end = std::optional<int>();
+      for (auto r = size_t{ }; r < mask.rows.size(); ++r) {
+        const auto& span = mask.rows[r];
+        if (span.x0 >= span.x1)
+          continue;
+        const auto& row = m_rows[to_unsigned(y + mask.top) + r];
+        const auto x0 = x + span.x0;
+        const auto x1 = x + span.x1;
+        const auto it = std::upper_bound(row.begin(), row.end(), x0,
+          [](int x, const Span& occupied) { return x < occupied.x1; });
+        if (it != row.end() && it->x0 < x1)
+          end = std::max(end.value_or(x), it->x1 - span.x0);
+      }
+      return end;
+    }
+
+    void add(const SpriteMask& mask, int x, int y, int padding) {
+      for (auto r = 0; r < to_int(mask.rows.size()); ++r) {
+        const auto& span = mask.rows[to_unsigned(r)];
+        if (span.x0 >= span.x1)
+          continue;
+        const auto row = y + mask.top + r;
+        for (auto py = row - padding; py <= row + padding; ++py)
+          if (py >= 0 && py < to_int(m_rows.size()))
+            add_span(m_rows[to_unsigned(py)], {
+              x + span.x0 - padding, x + span.x1 + padding });
+      }
+    }
+
+  private:
+    static void add_span(std::vector<Span>& row, Span span) {
+      auto begin = std::lower_bound(row.begin(), row.end(), span.x0,
+        [](const Span& occupied, int x) { return occupied.x1 < x; });
+      auto end = begin;
+      while (end != row.end() && end->x0 <= span.x1) {
+        span.x0 = std::min(span.x0, end->x0);
+        span.x1 = std::max(span.x1, end->x1);
+        ++end;
+      }
+      row.insert(row.erase(begin, end), span);
+    }
+
+    std::vector<std::vector<Span>> m_rows;
+  };
+
+  // bottom-left-fill of the sprites' pixel masks, keeps the slice's
+  // binpack layout when a sprite does not fit
   void compact_sprites(const Slice& slice, int border_padding, int shape_padding) {
+    const auto& sprites = slice.sprites;
+    auto masks = std::vector<SpriteMask>();
+    auto order = std::vector<size_t>();
+    for (const auto& sprite : sprites) {
+      order.push_back(masks.size());
+      masks.push_back(get_sprite_mask(sprite));
+    }
+
+    // place highest sprites first
+    std::stable_sort(order.begin(), order.end(),
+      [&](size_t a, size_t b) {
+        return std::make_pair(masks[a].rows.size(), masks[a].width - masks[a].left) >
+               std::make_pair(masks[b].rows.size(), masks[b].width - masks[b].left);
+      });
+
+    auto positions = std::vector<Point>(sprites.size());
+    auto occupancy = Occupancy(slice.height);
+    for (const auto index : order) {
+      const auto& mask = masks[index];
+      const auto& sprite = sprites[index];
+      // the slice size is deduced from the bounds
+      const auto size = (sprite.rotated ? 
+        Size{ sprite.bounds.y, sprite.bounds.x } : sprite.bounds);
+      const auto x_end = slice.width - border_padding - 
+        std::max(mask.width, size.x);
+      const auto y_end = slice.height - border_padding - 
+        std::max(mask.bottom(), size.y);
+      const auto find_position = [&]() -> std::optional<Point> {
+        for (auto y = border_padding - mask.top; y <= y_end; ++y)
+          for (auto x = border_padding - mask.left; x <= x_end; ) {
+            const auto collision_end = occupancy.get_collision_end(mask, x, y);
+            if (!collision_end)
+              return Point{ x, y };
+            x = *collision_end;
+          }
+        return std::nullopt;
+      };
+      const auto position = find_position();
+      if (!position)
+        return;
+      positions[index] = *position;
+      occupancy.add(mask, position->x, position->y, shape_padding);
+    }
+
+    for (auto i = size_t{ }; i < sprites.size(); ++i) {
+      sprites[i].trimmed_rect.x = positions[i].x;
+      sprites[i].trimmed_rect.y = positions[i].y;
+    }
+  }
+
+  void simulate_compact_sprites(const Slice& slice, int border_padding, int shape_padding) {
     auto space_ptr = SpacePtr(cpSpaceNew());
     const auto space = space_ptr.get();
 
@@ -51,10 +205,43 @@ namespace {
         to_int(vertices.size()), vertices.data(), cpTransformIdentity, padding)));
     }
 
-    // TODO: improve
-    for (auto i = 0; i < 1000; i++) {
-      cpSpaceSetGravity(space, cpVect{ 20.0 * ((i / 100) % 2 ? 1 : -1), -100 });
-      cpSpaceStep(space, 1.0 / 60);
+    const auto is_settled = [&]() {
+      // mean speed below one pixel per second
+      auto energy = 0.0;
+      auto sleeping = true;
+      for (const auto& body : bodies) {
+        energy += cpBodyKineticEnergy(body.get());
+        sleeping &= (cpBodyIsSleeping(body.get()) != cpFalse);
+      }
+      return (sleeping || energy < to_real(bodies.size()));
+    };
+    const auto get_max_vertical_distance = [&](const std::vector<cpVect>& positions) {
+      auto distance = 0.0;
+      for (auto i = 0u; i < bodies.size(); ++i)
+        distance = std::max(distance, std::fabs(positions[i].y -
+          cpBodyGetPosition(bodies[i].get()).y));
+      return distance;
+    };
+
+    // alternate horizontal gravity in phases, skip the rest of a phase once the
+    // bodies settled and stop when they did not fall further in two successive phases
+    const auto phases = 10;
+    const auto steps_per_phase = 100;
+    const auto min_steps = 10;
+    cpSpaceSetSleepTimeThreshold(space, 0.5);
+    auto positions = std::vector<cpVect>(bodies.size());
+    auto resting_phases = 0;
+    for (auto phase = 0; phase < phases && resting_phases < 2; ++phase) {
+      for (auto i = 0u; i < bodies.size(); ++i)
+        positions[i] = cpBodyGetPosition(bodies[i].get());
+
+      cpSpaceSetGravity(space, cpVect{ 20.0 * (phase % 2 ? 1 : -1), -100 });
+      for (auto i = 0; i < steps_per_phase; ++i) {
+        cpSpaceStep(space, 1.0 / 60);
+        if (i >= min_steps && is_settled())
+          break;
+      }
+      resting_phases = (get_max_vertical_distance(positions) < 1 ? resting_phases + 1 : 0);
     }
 
     auto i = 0u;
@@ -71,13 +258,21 @@ namespace {
 } // namespace
 
 void pack_compact(const SheetPtr& sheet, SpriteSpan sprites,
-    std::vector<Slice>& slices) {
+    std::vector<Slice>& slices, bool simulate) {
   const auto fast = (sheet->allow_rotate == false);
+  const auto first_slice = slices.size();
   pack_binpack(sheet, sprites, slices, fast);
-  for (auto& slice : slices) {
-    recompute_slice_size(slice);
-    compact_sprites(slice, sheet->border_padding, sheet->shape_padding);
-  }
+
+  // each slice is compacted independently
+  auto sheet_slices = span<Slice>(slices).subspan(first_slice);
+  scheduler.for_each_parallel(sheet_slices.begin(), sheet_slices.end(),
+    [&](Slice& slice) {
+      recompute_slice_size(slice);
+      if (simulate)
+        simulate_compact_sprites(slice, sheet->border_padding, sheet->shape_padding);
+      else
+        compact_sprites(slice, sheet->border_padding, sheet->shape_padding);
+    });
 }
 
 } // namespace
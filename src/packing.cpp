@@ -1,5 +1,6 @@
 
 #include "packing.h"
+#include "archive.h"
 #include <unordered_set>
 
 namespace spright {
@@ -27,6 +28,14 @@ namespace {
       ceil(size.x + 2 * s.extrude.count, s.divisible_bounds.x));
     s.bounds.y = std::max(s.min_bounds.y,
       ceil(size.y + 2 * s.extrude.count, s.divisible_bounds.y));
+
+    // keep sprites in separate texels down to the bleed-free mipmap level
+    if (const auto alignment = (s.sheet ? get_mipmap_alignment(*s.sheet) : 1);
+        alignment > 1) {
+      const auto padding = s.sheet->shape_padding;
+      s.bounds.x = ceil(s.bounds.x + padding, alignment) - padding;
+      s.bounds.y = ceil(s.bounds.y + padding, alignment) - padding;
+    }
   }
 
   void update_sprite_alignment(Sprite& s) {
@@ -133,13 +142,15 @@ namespace {
     s.pivot.y += (pivot_rect.y - s.trimmed_source_rect.y);
   }
 
-  void pack_slice(const SheetPtr& sheet,
-      SpriteSpan sprites, std::vector<Slice>& slices) {
+  void pack_slice(const SheetPtr& sheet, SpriteSpan sprites, 
+      std::vector<Slice>& slices, const SheetLayout* previous_layout) {
     assert(!sprites.empty());
 
     switch (sheet->pack) {
-      case Pack::binpack: return pack_binpack(sheet, sprites, slices, sprites.size() > 1000);
-      case Pack::compact: return pack_compact(sheet, sprites, slices);
+      case Pack::binpack: return pack_binpack(sheet, sprites, slices, 
+        sprites.size() > 1000, previous_layout);
+      case Pack::compact: return pack_compact(sheet, sprites, slices, false);
+      case Pack::compact_physics: return pack_compact(sheet, sprites, slices, true);
       case Pack::single: return pack_single(sheet, sprites, slices);
       case Pack::keep: return pack_keep(sheet, sprites, slices);
       case Pack::rows: return pack_lines(sheet, sprites, slices, true);
@@ -149,8 +160,8 @@ namespace {
     }
   }
 
-  void pack_slice_deduplicate(const SheetPtr& sheet,
-      SpriteSpan sprites, std::vector<Slice>& slices) {
+  void pack_slice_deduplicate(const SheetPtr& sheet, SpriteSpan sprites,
+      std::vector<Slice>& slices, const SheetLayout* previous_layout) {
     assert(!sprites.empty());
 
     // sort duplicates to back
@@ -173,7 +184,7 @@ namespace {
     std::sort(unique_sprites.begin(), unique_sprites.end(),
       [](const Sprite& a, const Sprite& b) { return (a.index < b.index); });
 
-    pack_slice(sheet, unique_sprites, slices);
+    pack_slice(sheet, unique_sprites, slices, previous_layout);
 
     const auto duplicate_sprites = sprites.last(sprites.size() - unique_sprites.size());
     if (sheet->duplicates == Duplicates::drop) {
@@ -194,7 +205,16 @@ namespace {
     }
   }
 
-  std::vector<Slice> pack_sprites_by_sheet(SpriteSpan sprites) {
+  const SheetLayout* find_sheet_layout(const PackingLayout& layout,
+      const Sheet& sheet) {
+    if (!sheet.stable)
+      return nullptr;
+    const auto it = layout.find(sheet.id);
+    return (it != layout.end() ? &it->second : nullptr);
+  }
+
+  std::vector<Slice> pack_sprites_by_sheet(SpriteSpan sprites,
+      const PackingLayout& previous_layout) {
     if (sprites.empty())
       return { };
 
@@ -210,10 +230,11 @@ namespace {
       if (it == sprites.end() ||
           it->sheet != begin->sheet) {
         const auto& sheet = begin->sheet;
+        const auto layout = find_sheet_layout(previous_layout, *sheet);
         if (sheet->duplicates != Duplicates::keep)
-          pack_slice_deduplicate(sheet, { begin, it }, slices);
+          pack_slice_deduplicate(sheet, { begin, it }, slices, layout);
         else
-          pack_slice(sheet, { begin, it }, slices);
+          pack_slice(sheet, { begin, it }, slices, layout);
 
         if (it == sprites.end())
           break;
@@ -240,6 +261,16 @@ namespace {
   }
 } // namespace
 
+int get_mipmap_alignment(const Sheet& sheet) {
+  // mipmaps are generated after scaling, downscaled outputs need more
+  auto alignment = 1;
+  for (const auto& output : sheet.outputs)
+    if (output->mipmaps && output->mipmap_bleed_free_level)
+      alignment = std::max(alignment, ceil_to_pot(to_int(std::ceil(
+        (1 << output->mipmap_bleed_free_level) / output->scale))));
+  return alignment;
+}
+
 std::pair<int, int> get_slice_max_size(const Sheet& sheet) {
   return {
     get_max_size(sheet.width, sheet.max_width, sheet.power_of_two),
@@ -247,7 +278,8 @@ std::pair<int, int> get_slice_max_size(const Sheet& sheet) {
   };
 }
 
-std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
+std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites,
+    const PackingLayout& previous_layout) {
   for (auto& sprite : sprites)
     update_sprite_bounds(sprite);
 
@@ -263,7 +295,15 @@ std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
     if (sprite.align_pivot.empty())
       update_sprite_alignment(sprite);
 
-  auto slices = pack_sprites_by_sheet(sprites);
+  auto slices = pack_sprites_by_sheet(sprites, previous_layout);
+
+  for (const auto& sprite : sprites)
+    if (sprite.sheet && sprite.slice_index >= 0) {
+      const auto alignment = get_mipmap_alignment(*sprite.sheet);
+      if (sprite.trimmed_rect.x % alignment || sprite.trimmed_rect.y % alignment)
+        warning("sprite is not aligned for bleed-free mipmaps",
+          sprite.warning_line_number);
+    }
 
   for (auto& sprite : sprites) {
     update_sprite_rect(sprite);
@@ -286,6 +326,43 @@ std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
   return slices;
 }
 
+std::string get_sprite_layout_key(const Sprite& sprite) {
+  // identify sprites by their untransformed source rect
+  const auto& source = (sprite.untransformed_source ? 
+    sprite.untransformed_source : sprite.source);
+  const auto& rect = (sprite.untransformed_source ? 
+    sprite.untransformed_source_rect : sprite.source_rect);
+  auto ss = std::ostringstream();
+  if (source)
+    ss << path_to_utf8(source->path() / source->filename());
+  ss << '|' << rect.x << ',' << rect.y << ',' << rect.w << ',' << rect.h;
+  return ss.str();
+}
+
+PackingLayout get_packing_layout(const std::vector<Sprite>& sprites) {
+  auto layout = PackingLayout();
+  for (const auto& sprite : sprites) {
+    if (!sprite.sheet || !sprite.sheet->stable || 
+        sprite.sheet->pack != Pack::binpack ||
+        sprite.slice_index < 0 || sprite.duplicate_of_index >= 0)
+      continue;
+
+    const auto size = (sprite.rotated ? 
+      Size{ sprite.bounds.y, sprite.bounds.x } : sprite.bounds);
+    layout[sprite.sheet->id].emplace(get_sprite_layout_key(sprite), 
+      PackedSprite{
+        sprite.slice_index,
+        Rect{ 
+          sprite.trimmed_rect.x - sprite.align.x, 
+          sprite.trimmed_rect.y - sprite.align.y, 
+          size.x, size.y 
+        },
+        sprite.rotated,
+      });
+  }
+  return layout;
+}
+
 void create_slices_from_indices(const SheetPtr& sheet_ptr, 
     SpriteSpan sprites, std::vector<Slice>& slices) {
 
@@ -337,6 +414,12 @@ void recompute_slice_size(Slice& slice) {
     slice.width = ceil_to_pot(slice.width);
     slice.height = ceil_to_pot(slice.height);
   }
+
+  // mipmap levels halve the size exactly down to the bleed-free level
+  if (const auto alignment = get_mipmap_alignment(sheet); alignment > 1) {
+    slice.width = ceil(slice.width, alignment);
+    slice.height = ceil(slice.height, alignment);
+  }
   if (sheet.square)
     slice.width = slice.height = std::max(slice.width, slice.height);
 }
@@ -351,7 +434,8 @@ void update_last_source_written_times(std::vector<Slice>& slices) {
         sources.insert(sprite.source.get());
       for (const auto& source : sources)
         last_write_time = std::max(last_write_time,
-          get_last_write_time(source->path() / source->filename()));
+          get_last_write_time(get_containing_file(
+            source->path() / source->filename())));
 
       slice.last_source_written_time = last_write_time;
     });
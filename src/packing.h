@@ -18,18 +18,33 @@ struct Slice {
   std::optional<std::filesystem::file_time_type> last_source_written_time;
 };
 
+// placement of a sprite in a previous run, restored by stable packing
+struct PackedSprite {
+  int slice_index{ };
+  Rect rect{ };
+  bool rotated{ };
+};
+// sprites by layout key, layouts by sheet id
+using SheetLayout = std::map<std::string, PackedSprite, std::less<>>;
+using PackingLayout = std::map<std::string, SheetLayout, std::less<>>;
+
+int get_mipmap_alignment(const Sheet& sheet);
 std::pair<int, int> get_slice_max_size(const Sheet& sheet);
 void create_slices_from_indices(const SheetPtr& sheet_ptr, 
     SpriteSpan sprites, std::vector<Slice>& slices);
 void recompute_slice_size(Slice& slice);
 void update_last_source_written_times(std::vector<Slice>& slices);
 
-std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites);
+std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites,
+  const PackingLayout& previous_layout = { });
+std::string get_sprite_layout_key(const Sprite& sprite);
+PackingLayout get_packing_layout(const std::vector<Sprite>& sprites);
 
 void pack_binpack(const SheetPtr& sheet, SpriteSpan sprites,
-  std::vector<Slice>& slices, bool fast);
+  std::vector<Slice>& slices, bool fast, 
+  const SheetLayout* previous_layout = nullptr);
 void pack_compact(const SheetPtr& sheet, SpriteSpan sprites,
-  std::vector<Slice>& slices);
+  std::vector<Slice>& slices, bool simulate);
 void pack_single(const SheetPtr& sheet, SpriteSpan sprites,
   std::vector<Slice>& slices);
 void pack_keep(const SheetPtr& sheet, SpriteSpan sprites,
@@ -61,6 +61,21 @@ bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
         return false;
       settings.output_path = utf8_to_path(unquote(argv[i]));
     }
+    else if (argument == "--manifest") {
+      if (++i >= argc)
+        return false;
+      settings.manifest_file = utf8_to_path(unquote(argv[i]));
+    }
+    else if (argument == "--image-cache") {
+      if (++i >= argc)
+        return false;
+      settings.image_cache_path = utf8_to_path(unquote(argv[i]));
+    }
+    else if (argument == "--bundle") {
+      if (++i >= argc)
+        return false;
+      settings.bundle_file = utf8_to_path(unquote(argv[i]));
+    }
     else if (argument == "-v" || argument == "--verbose") {
       settings.verbose = true;
     }
@@ -116,6 +131,11 @@ void print_help_message(const char* argv0) {
     "                     completed input definition (defaults to --input).\n"
     "  -t, --template <file>   template for the output description.\n"
     "  -p, --path <path>       path to prepend to all output files.\n"
+    "      --manifest <file>   file for storing content hashes of the inputs and\n"
+    "                     outputs of textures, used instead of modification times,\n"
+    "                     the sprite layout of stable sheets and the trim results.\n"
+    "      --image-cache <dir> directory for storing decoded input images.\n"
+    "      --bundle <file>     ZIP archive for writing all output files into.\n"
     "  -v, --verbose           enable verbose messages.\n"
     "  -h, --help              print this help.\n"
     "\n"
@@ -23,6 +23,9 @@ struct Settings {
   std::filesystem::path output_file;
   bool output_file_set{ };
   std::filesystem::path template_file;
+  std::filesystem::path manifest_file;
+  std::filesystem::path image_cache_path;
+  std::filesystem::path bundle_file;
   std::string autocomplete_pattern;
   bool verbose{ };
 };
@@ -1,6 +1,7 @@
 
 #include "trimming.h"
 #include "chipmunk/chipmunk.h"
+#include <mutex>
 extern "C" {
 #include "chipmunk/cpPolyline.h"
 #include "chipmunk/cpMarch.h"
@@ -12,78 +13,91 @@ namespace {
   struct FreePolyline { void operator()(cpPolyline* line) { cpPolylineFree(line); }; };
   using PolylinePtr = std::unique_ptr<cpPolyline, FreePolyline>;
 
+  struct FreePolylineSet { void operator()(cpPolylineSet* set) { cpPolylineSetFree(set, true); }; };
+  using PolylineSetPtr = std::unique_ptr<cpPolylineSet, FreePolylineSet>;
+
+  PolylinePtr new_polyline(int count) {
+    auto polyline = PolylinePtr(static_cast<cpPolyline*>(cpcalloc(1,
+      sizeof(cpPolyline) + to_unsigned(count) * sizeof(cpVect))));
+    polyline->capacity = count;
+    polyline->count = count;
+    return polyline;
+  }
+
+  // concatenates the vertices of all polylines
   PolylinePtr merge_polylines(const cpPolylineSet& polyline_set) {
-    // TODO: find closest segments
-    // rotate vertices of one to begin at segment and delete end
-    // insert into other polyline at segment
-#if 0
     auto count = 0;
     for (auto i = 0; i < polyline_set.count; ++i)
       count += polyline_set.lines[i]->count;
 
-    auto merged = PolylinePtr(static_cast<cpPolyline*>(cpcalloc(1,
-      sizeof(cpPolyline) + to_unsigned(count) * sizeof(cpVect))));
-    merged->capacity = count;
-    merged->count = count;
-
+    auto merged = new_polyline(count);
     auto pos = merged->verts;
     for (auto i = 0; i < polyline_set.count; ++i) {
       auto line = polyline_set.lines[i];
       std::copy(line->verts, line->verts + line->count, pos);
       pos += line->count;
     }
-#else
-    auto line = std::add_pointer_t<cpPolyline>{ };
-    for (auto i = 0; i < polyline_set.count; ++i)
-      if (!line || polyline_set.lines[i]->count > line->count)
-        line = polyline_set.lines[i];
-
-    auto merged = PolylinePtr(static_cast<cpPolyline*>(cpcalloc(1,
-      sizeof(cpPolyline) + to_unsigned(line->count) * sizeof(cpVect))));
-    merged->capacity = line->count;
-    merged->count = line->count;
-
-    std::copy(line->verts, line->verts + line->count, merged->verts);
-#endif
     return merged;
   }
 
-  PolylinePtr get_polygon_outline(ImageView<const RGBA::Channel> image_mono, 
-      int threshold) {
+  // marches the pixels within rect, the vertices are in image coordinates
+  void march_outlines(ImageView<const RGBA::Channel> image_mono,
+      int threshold, const Rect& rect, cpPolylineSet& outlines) {
+    struct Data {
+      ImageView<const RGBA::Channel> image_mono;
+      Rect rect;
+    };
     const auto sample = [](cpVect point, void *data) -> cpFloat {
-      const auto& image_mono = *static_cast<ImageView<const RGBA::Channel>*>(data);
+      const auto& [image_mono, rect] = *static_cast<Data*>(data);
       const auto x = to_int(point.x - 0.5);
       const auto y = to_int(point.y - 0.5);
-      if (x < 0 || x >= image_mono.width() || 
-          y < 0 || y >= image_mono.height())
+      if (x < rect.x0() || x >= rect.x1() || 
+          y < rect.y0() || y >= rect.y1())
         return 0;
       return image_mono.value_at({ x, y });
     };
 
-    const auto outlines = cpPolylineSetNew();
+    auto data = Data{ image_mono, rect };
     cpMarchHard(
-      { -1, -1, to_real(image_mono.width() + 1), to_real(image_mono.height() + 1) },
-      to_unsigned(image_mono.width() + 3),
-      to_unsigned(image_mono.height() + 3),
+      { to_real(rect.x - 1), to_real(rect.y - 1), 
+        to_real(rect.x1() + 1), to_real(rect.y1() + 1) },
+      to_unsigned(rect.w + 3),
+      to_unsigned(rect.h + 3),
       threshold - 1,
-      reinterpret_cast<cpMarchSegmentFunc>(cpPolylineSetCollectSegment), outlines,
-      sample, &image_mono);
+      reinterpret_cast<cpMarchSegmentFunc>(cpPolylineSetCollectSegment), &outlines,
+      sample, &data);
 
-    assert(outlines->count > 0);
-    const auto right = cpFloat(image_mono.width());
-    const auto bottom = cpFloat(image_mono.height());
-    for (auto i = 0; i < outlines->count; ++i) {
-      auto& line = *outlines->lines[i];
+    // vertices are interpolated between the samples, snap them to
+    // half pixels so they do not depend on the marched rect
+    for (auto i = 0; i < outlines.count; ++i) {
+      auto& line = *outlines.lines[i];
+      for (auto j = 0; j < line.count; ++j) {
+        line.verts[j].x = std::round(line.verts[j].x * 2) / 2;
+        line.verts[j].y = std::round(line.verts[j].y * 2) / 2;
+      }
+    }
+  }
+
+  void clamp_outlines(cpPolylineSet& outlines, const Size& size) {
+    const auto right = cpFloat(size.x);
+    const auto bottom = cpFloat(size.y);
+    for (auto i = 0; i < outlines.count; ++i) {
+      auto& line = *outlines.lines[i];
       auto& verts = line.verts;
       for (auto j = 0; j < line.count; ++j) {
         verts[j].x = std::clamp(verts[j].x, cpFloat{ }, right);
         verts[j].y = std::clamp(verts[j].y, cpFloat{ }, bottom);
       }
     }
+  }
 
-    auto outline = PolylinePtr(merge_polylines(*outlines));
-    cpPolylineSetFree(outlines, true);
-    return outline;
+  PolylineSetPtr get_polygon_outlines(ImageView<const RGBA::Channel> image_mono, 
+      int threshold) {
+    auto outlines = PolylineSetPtr(cpPolylineSetNew());
+    march_outlines(image_mono, threshold, image_mono.bounds(), *outlines);
+    assert(outlines->count > 0);
+    clamp_outlines(*outlines, image_mono.bounds().size());
+    return outlines;
   }
 
   cpVect normal(const cpVect& v) {
@@ -114,9 +128,33 @@ namespace {
     }
   }
 
+  // removes the vertices on the edge between their neighbors,
+  // which the hull otherwise keeps depending on the vertex order
+  void remove_collinear_vertices(cpPolyline& hull) {
+    // the last vertex closes the hull
+    const auto count = hull.count - 1;
+    if (count < 3)
+      return;
+    auto vertices = std::vector<cpVect>();
+    for (auto i = 0; i < count; ++i) {
+      const auto& p0 = hull.verts[(i + count - 1) % count];
+      const auto& p1 = hull.verts[i];
+      const auto& p2 = hull.verts[(i + 1) % count];
+      if ((p1.x - p0.x) * (p2.y - p1.y) != (p1.y - p0.y) * (p2.x - p1.x))
+        vertices.push_back(p1);
+    }
+    if (vertices.size() < 3)
+      return;
+    std::copy(vertices.begin(), vertices.end(), hull.verts);
+    hull.verts[vertices.size()] = vertices.front();
+    hull.count = to_int(vertices.size()) + 1;
+  }
+
   PolylinePtr to_convex_polygon(const cpPolyline& polyline, real tolerance) {
-    return PolylinePtr(cpPolylineToConvexHull(
+    auto hull = PolylinePtr(cpPolylineToConvexHull(
       const_cast<cpPolyline*>(&polyline), tolerance));
+    remove_collinear_vertices(*hull);
+    return hull;
   }
 
   PolylinePtr simplify_polygon(const cpPolyline& polyline, real tolerance) {
@@ -135,45 +173,433 @@ namespace {
     return vertices;
   }
 
-  void trim_sprite(Sprite& sprite) {
-    
-    if (sprite.trim != Trim::none) {
-      sprite.trimmed_source_rect = get_used_bounds(*sprite.source,
-        sprite.trim_gray_levels, sprite.trim_threshold, sprite.source_rect);
-  
-      if (sprite.trim_margin)
-        sprite.trimmed_source_rect = intersect(expand(
-          sprite.trimmed_source_rect, sprite.trim_margin), sprite.source_rect);
+  // moves each edge outwards by the distance, sharp convex corners are
+  // capped, so all points within the distance of the polygon are enclosed
+  std::vector<PointF> offset_polygon(const cpPolyline& polyline, real distance) {
+    const auto count = polyline.count;
+    auto vertices = std::vector<PointF>();
+    vertices.reserve(to_unsigned(count) * 2);
+    for (auto i = 0; i < count; ++i) {
+      const auto& p0 = polyline.verts[(i + count - 1) % count];
+      const auto& p1 = polyline.verts[i];
+      const auto& p2 = polyline.verts[(i + 1) % count];
+      const auto n0 = normal({ p1.x - p0.x, p1.y - p0.y });
+      const auto n1 = normal({ p2.x - p1.x, p2.y - p1.y });
+      const auto d0 = cpVect{ -n0.y, n0.x };
+      const auto d1 = cpVect{ -n1.y, n1.x };
+      const auto dot = n0.x * n1.x + n0.y * n1.y;
+      const auto convex = (n0.x * d1.x + n0.y * d1.y < 0);
+      if (convex && dot < 0) {
+        vertices.push_back({ p1.x + (n0.x + d0.x) * distance, 
+                             p1.y + (n0.y + d0.y) * distance });
+        vertices.push_back({ p1.x + (n1.x - d1.x) * distance, 
+                             p1.y + (n1.y - d1.y) * distance });
+      }
+      else {
+        const auto miter = distance / std::max(1 + dot, 1e-6);
+        vertices.push_back({ p1.x + (n0.x + n1.x) * miter, 
+                             p1.y + (n0.y + n1.y) * miter });
+      }
     }
-    else {
-      sprite.trimmed_source_rect = sprite.source_rect;
+    return vertices;
+  }
+
+  real cross(const PointF& a, const PointF& b, const PointF& c) {
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  }
+
+  // whether the segments cross, touching or overlapping is not crossing
+  bool segments_cross(const PointF& a0, const PointF& a1, 
+      const PointF& b0, const PointF& b1) {
+    const auto opposite = [](real u, real v) { return (u < 0 && v > 0) || (u > 0 && v < 0); };
+    return opposite(cross(a0, a1, b0), cross(a0, a1, b1)) &&
+           opposite(cross(b0, b1, a0), cross(b0, b1, a1));
+  }
+
+  bool polygons_cross(const std::vector<PointF>& a, const std::vector<PointF>& b) {
+    for (auto i = size_t{ }; i < a.size(); ++i)
+      for (auto j = size_t{ }; j < b.size(); ++j)
+        if (segments_cross(a[i], a[(i + 1) % a.size()], 
+                           b[j], b[(j + 1) % b.size()]))
+          return true;
+    return false;
+  }
+
+  bool is_self_intersecting(const std::vector<PointF>& polygon) {
+    const auto count = polygon.size();
+    for (auto i = size_t{ }; i < count; ++i)
+      for (auto j = i + 2; j < count; ++j)
+        if (segments_cross(polygon[i], polygon[i + 1], 
+                           polygon[j], polygon[(j + 1) % count]))
+          return true;
+    return false;
+  }
+
+  bool contains(const std::vector<PointF>& outer, const std::vector<PointF>& inner) {
+    return std::all_of(inner.begin(), inner.end(), [&](const PointF& point) {
+        return point_in_polygon(point.x, point.y, outer);
+      }) && !polygons_cross(outer, inner);
+  }
+
+  std::vector<PointF> get_convex_hull(const std::vector<PointF>& a, 
+      const std::vector<PointF>& b = { }) {
+    auto points = new_polyline(to_int(a.size() + b.size()));
+    const auto to_vect = [](const PointF& point) { return cpVect{ point.x, point.y }; };
+    std::transform(a.begin(), a.end(), points->verts, to_vect);
+    std::transform(b.begin(), b.end(), points->verts + a.size(), to_vect);
+    auto hull = to_point_list(*to_convex_polygon(*points, 0));
+    // the last vertex closes the hull
+    hull.pop_back();
+    return hull;
+  }
+
+  // replaces self-intersecting islands and overlapping islands by their
+  // convex hull, islands within another island are dropped
+  void merge_overlapping_islands(std::vector<std::vector<PointF>>& islands) {
+    for (auto& island : islands)
+      if (is_self_intersecting(island))
+        island = get_convex_hull(island);
+
+    const auto merge_two = [&]() {
+      for (auto i = size_t{ }; i < islands.size(); ++i)
+        for (auto j = size_t{ }; j < islands.size(); ++j) {
+          if (i == j)
+            continue;
+          if (polygons_cross(islands[i], islands[j]))
+            islands[i] = get_convex_hull(islands[i], islands[j]);
+          else if (!contains(islands[i], islands[j]))
+            continue;
+          islands.erase(islands.begin() + static_cast<std::ptrdiff_t>(j));
+          return true;
+        }
+      return false;
+    };
+    while (merge_two()) { }
+  }
+
+  void clamp_vertices(std::vector<PointF>& vertices, const Size& size) {
+    for (auto& vertex : vertices) {
+      vertex.x = std::clamp(vertex.x, real{ }, to_real(size.x));
+      vertex.y = std::clamp(vertex.y, real{ }, to_real(size.y));
     }
+  }
 
-    if (sprite.trim == Trim::convex) {
-      const auto levels = (sprite.trim_gray_levels ?
-        get_gray_levels(*sprite.source, sprite.trimmed_source_rect) :
-        get_alpha_levels(*sprite.source, sprite.trimmed_source_rect));
+  // maximum of each block of pixels
+  Image get_max_pooled(ImageView<const RGBA::Channel> image_mono, int block_size) {
+    const auto width = div_ceil(image_mono.width(), block_size);
+    const auto height = div_ceil(image_mono.height(), block_size);
+    auto result = Image(width, height, RGBA::Channel{ });
+    const auto pooled = result.view<RGBA::Channel>();
+    for (auto y = 0; y < image_mono.height(); ++y) {
+      const auto row = image_mono.values_at(0, y);
+      const auto pooled_row = pooled.values_at(0, y / block_size);
+      for (auto x = 0; x < image_mono.width(); ++x) {
+        auto& value = pooled_row[x / block_size];
+        value = std::max(value, row[x]);
+      }
+    }
+    return result;
+  }
+
+  // marches a max-pooled image and only refines the blocks near its
+  // convex hull at full resolution, returns the hull vertices of the blocks
+  PolylinePtr get_coarse_to_fine_outline(
+      ImageView<const RGBA::Channel> image_mono, int threshold, int block_size) {
+    const auto pooled_image = get_max_pooled(image_mono, block_size);
+    const auto pooled = pooled_image.view<RGBA::Channel>();
+    const auto coarse_outlines = get_polygon_outlines(pooled, threshold);
+    const auto merged = merge_polylines(*coarse_outlines);
+    const auto hull = to_convex_polygon(*merged, 0);
+    if (hull->count < 3)
+      return merge_polylines(*get_polygon_outlines(image_mono, threshold));
 
-      auto outline = get_polygon_outline(
-        levels.view<RGBA::Channel>(), sprite.trim_threshold);
-      outline = to_convex_polygon(*outline, 0);
-      outline = simplify_polygon(*outline, 3);
-      expand_polygon(*outline, sprite.trim_margin);
-      sprite.vertices = to_point_list(*outline);
+    auto orientation = 0.0;
+    for (auto i = 0; i < hull->count; ++i) {
+      const auto& p0 = hull->verts[i];
+      const auto& p1 = hull->verts[(i + 1) % hull->count];
+      orientation += p0.x * p1.y - p1.x * p0.y;
+    }
+    orientation = (orientation < 0 ? -1.0 : 1.0);
+
+    // the outline of a block can be one block off,
+    // an extreme pixel of a block up to one block diagonal
+    const auto band = 3.0;
+    const auto distance_to_hull = [&](cpVect point) {
+      auto distance = std::numeric_limits<real>::max();
+      for (auto i = 0; i < hull->count; ++i) {
+        const auto& p0 = hull->verts[i];
+        const auto& p1 = hull->verts[(i + 1) % hull->count];
+        const auto edge = cpVect{ p1.x - p0.x, p1.y - p0.y };
+        const auto length = std::sqrt(edge.x * edge.x + edge.y * edge.y);
+        if (length == 0)
+          continue;
+        distance = std::min(distance, orientation * 
+          (edge.x * (point.y - p0.y) - edge.y * (point.x - p0.x)) / length);
+      }
+      return distance;
+    };
+
+    // collect blocks separately, joining segments is quadratic
+    auto vertices = std::vector<cpVect>();
+    for (auto y = 0; y < pooled.height(); ++y)
+      for (auto x = 0; x < pooled.width(); ++x)
+        if (pooled.value_at({ x, y }) >= threshold &&
+            distance_to_hull({ x + 1.0, y + 1.0 }) <= band) {
+          const auto rect = intersect(image_mono.bounds(), { 
+            x * block_size, y * block_size, block_size, block_size });
+          auto outlines = PolylineSetPtr(cpPolylineSetNew());
+          march_outlines(image_mono, threshold, rect, *outlines);
+          if (outlines->count == 0)
+            continue;
+          clamp_outlines(*outlines, image_mono.bounds().size());
+          const auto block_hull = to_convex_polygon(*merge_polylines(*outlines), 0);
+          vertices.insert(vertices.end(), block_hull->verts, 
+            block_hull->verts + block_hull->count);
+        }
+
+    if (vertices.empty())
+      return merge_polylines(*get_polygon_outlines(image_mono, threshold));
+    auto outline = new_polyline(to_int(vertices.size()));
+    std::copy(vertices.begin(), vertices.end(), outline->verts);
+    return outline;
+  }
+
+  // connects the islands by bridges between their closest vertices
+  std::vector<PointF> bridge_islands(std::vector<std::vector<PointF>> islands) {
+    auto polygon = std::move(islands.front());
+    for (auto k = size_t{ 1 }; k < islands.size(); ++k) {
+      const auto& island = islands[k];
+      auto closest = std::make_tuple(std::numeric_limits<real>::max(), size_t{ }, size_t{ });
+      for (auto i = size_t{ }; i < polygon.size(); ++i)
+        for (auto j = size_t{ }; j < island.size(); ++j) {
+          const auto dx = polygon[i].x - island[j].x;
+          const auto dy = polygon[i].y - island[j].y;
+          closest = std::min(closest, std::make_tuple(dx * dx + dy * dy, i, j));
+        }
+
+      const auto [distance, i, j] = closest;
+      auto bridged = std::vector<PointF>();
+      bridged.reserve(polygon.size() + island.size() + 2);
+      bridged.insert(bridged.end(), polygon.begin(), polygon.begin() + to_int(i) + 1);
+      for (auto n = size_t{ }; n <= island.size(); ++n)
+        bridged.push_back(island[(j + n) % island.size()]);
+      bridged.insert(bridged.end(), polygon.begin() + to_int(i), polygon.end());
+      polygon = std::move(bridged);
+    }
+    return polygon;
+  }
+
+  // simplifies the outer outlines until they fit the vertex budget,
+  // returns an empty list when it can not be met
+  std::vector<PointF> get_concave_polygon(const cpPolylineSet& outlines, 
+      const Size& size, int margin, int max_vertices) {
+    // ignore holes and the islands within them
+    auto polygons = std::vector<std::vector<PointF>>();
+    for (auto i = 0; i < outlines.count; ++i)
+      polygons.push_back(to_point_list(*outlines.lines[i]));
+    auto outer = std::vector<const cpPolyline*>();
+    for (auto i = size_t{ }; i < polygons.size(); ++i) {
+      const auto inside = [&]() {
+        for (auto j = size_t{ }; j < polygons.size(); ++j)
+          if (i != j && point_in_polygon(polygons[i][0].x, 
+                polygons[i][0].y, polygons[j]))
+            return true;
+        return false;
+      };
+      if (!inside())
+        outer.push_back(outlines.lines[i]);
+    }
+
+    for (auto tolerance = 1.0; tolerance <= 8.0; tolerance *= 2) {
+      auto islands = std::vector<std::vector<PointF>>();
+      for (const auto* line : outer) {
+        auto simplified = simplify_polygon(*line, tolerance);
+        if (cpPolylineIsClosed(simplified.get()))
+          --simplified->count;
+        // thin islands can collapse to a line, enclose them by their hull
+        if (simplified->count < 3) {
+          simplified = to_convex_polygon(*line, 0);
+          --simplified->count;
+        }
+        if (simplified->count < 3)
+          return { };
+        // the simplified outline is within tolerance of the outline
+        auto vertices = offset_polygon(*simplified, margin + tolerance);
+        clamp_vertices(vertices, size);
+        islands.push_back(std::move(vertices));
+      }
+
+      merge_overlapping_islands(islands);
+      std::stable_sort(islands.begin(), islands.end(), 
+        [](const auto& a, const auto& b) { return a.size() > b.size(); });
+      auto count = 0;
+      for (const auto& island : islands)
+        count += to_int(island.size()) + (count ? 2 : 0);
+      if (count <= max_vertices) {
+        auto polygon = bridge_islands(std::move(islands));
+        if (is_self_intersecting(polygon))
+          return { };
+        return polygon;
+      }
+    }
+    return { };
+  }
+
+  std::vector<PointF> get_convex_polygon(const cpPolyline& outline, int margin) {
+    auto hull = to_convex_polygon(outline, 0);
+    hull = simplify_polygon(*hull, 3);
+    expand_polygon(*hull, margin);
+    return to_point_list(*hull);
+  }
+
+  // block size for marching a max-pooled image first,
+  // large sprites are pooled to about 128 blocks per side
+  int get_outline_block_size(const Size& size) {
+    const auto block_size = std::max(size.x, size.y) / 128;
+    return (block_size >= 4 ? block_size : 1);
+  }
+
+  PolylinePtr get_convex_outline(ImageView<const RGBA::Channel> image_mono,
+      int threshold, int block_size) {
+    return (block_size > 1 ?
+      get_coarse_to_fine_outline(image_mono, threshold, block_size) :
+      merge_polylines(*get_polygon_outlines(image_mono, threshold)));
+  }
+
+  std::vector<PointF> get_outline_vertices(const Sprite& sprite, 
+      const Image& levels) {
+    const auto levels_mono = levels.view<RGBA::Channel>();
+    if (sprite.trim == Trim::polygon) {
+      const auto outlines = get_polygon_outlines(levels_mono, 
+        sprite.trim_threshold);
+      auto vertices = get_concave_polygon(*outlines, 
+        levels_mono.bounds().size(), sprite.trim_margin, 
+        sprite.trim_max_vertices);
+      if (vertices.empty())
+        vertices = get_convex_polygon(*merge_polylines(*outlines), 
+          sprite.trim_margin);
+      return vertices;
+    }
+    const auto block_size = get_outline_block_size(
+      levels_mono.bounds().size());
+    const auto outline = get_convex_outline(levels_mono, 
+      sprite.trim_threshold, block_size);
+    return get_convex_polygon(*outline, sprite.trim_margin);
+  }
+
+  std::vector<PointF> get_rect_vertices(const Size& size) {
+    const auto w = to_real(size.x);
+    const auto h = to_real(size.y);
+    return { { 0, 0 }, { w, 0 }, { w, h }, { 0, h } };
+  }
+
+  TrimResult get_trim_result(const Sprite& sprite) {
+    auto rect = get_used_bounds(*sprite.source,
+      sprite.trim_gray_levels, sprite.trim_threshold, sprite.source_rect);
+
+    if (sprite.trim_margin)
+      rect = intersect(expand(rect, sprite.trim_margin), sprite.source_rect);
+
+    auto vertices = std::vector<PointF>();
+    if (sprite.trim == Trim::convex || sprite.trim == Trim::polygon) {
+      const auto levels = (sprite.trim_gray_levels ?
+        get_gray_levels(*sprite.source, rect) :
+        get_alpha_levels(*sprite.source, rect));
+      vertices = get_outline_vertices(sprite, levels);
     }
     else {
-      const auto w = to_real(sprite.trimmed_source_rect.w);
-      const auto h = to_real(sprite.trimmed_source_rect.h);
-      sprite.vertices.push_back({ 0, 0 });
-      sprite.vertices.push_back({ w, 0 });
-      sprite.vertices.push_back({ w, h });
-      sprite.vertices.push_back({ 0, h });
+      vertices = get_rect_vertices(rect.size());
+    }
+    rect.x -= sprite.source_rect.x;
+    rect.y -= sprite.source_rect.y;
+    return { rect, std::move(vertices) };
+  }
+
+  // increase when trimming the same source changes
+  const auto trim_cache_version = 3;
+
+  uint64_t get_trim_key(const Sprite& sprite) {
+    const auto rect = intersect(sprite.source_rect, sprite.source->bounds());
+    const auto source_rgba = sprite.source->view<RGBA>();
+    auto hasher = Hasher();
+    hasher.add_value(trim_cache_version);
+    hasher.add_value(rect.w);
+    hasher.add_value(rect.h);
+    for (auto y = rect.y0(); y < rect.y1(); ++y)
+      hasher.add(source_rgba.values_at(rect.x, y), 
+        to_unsigned(rect.w) * sizeof(RGBA));
+    hasher.add_value(sprite.trim);
+    hasher.add_value(sprite.trim_threshold);
+    hasher.add_value(sprite.trim_margin);
+    hasher.add_value(sprite.trim_gray_levels);
+    hasher.add_value(sprite.trim_max_vertices);
+    return hasher.value();
+  }
+
+  // sprites with identical content and trim settings are only trimmed once
+  class TrimResults {
+  public:
+    explicit TrimResults(const TrimCache& previous_cache)
+      : m_previous_cache(previous_cache) {
+    }
+
+    std::optional<TrimResult> find(uint64_t key) {
+      auto lock = std::lock_guard(m_mutex);
+      if (auto it = m_results.find(key); it != m_results.end())
+        return it->second;
+      if (auto it = m_previous_cache.find(key); it != m_previous_cache.end())
+        return m_results.emplace(key, it->second).first->second;
+      return std::nullopt;
+    }
+
+    void insert(uint64_t key, const TrimResult& result) {
+      auto lock = std::lock_guard(m_mutex);
+      m_results.emplace(key, result);
+    }
+
+    TrimCache release() { 
+      return std::move(m_results);
+    }
+
+  private:
+    const TrimCache& m_previous_cache;
+    std::mutex m_mutex;
+    TrimCache m_results;
+  };
+
+  void trim_sprite(Sprite& sprite, TrimResults& results) {
+    if (sprite.trim == Trim::none) {
+      sprite.trimmed_source_rect = sprite.source_rect;
+      sprite.vertices = get_rect_vertices(sprite.source_rect.size());
+      return;
     }
+
+    const auto key = get_trim_key(sprite);
+    auto result = results.find(key);
+    if (!result) {
+      result = get_trim_result(sprite);
+      results.insert(key, *result);
+    }
+    sprite.trimmed_source_rect = result->trimmed_rect;
+    sprite.trimmed_source_rect.x += sprite.source_rect.x;
+    sprite.trimmed_source_rect.y += sprite.source_rect.y;
+    sprite.vertices = std::move(result->vertices);
   }
 } // namespace
 
-void trim_sprites(std::vector<Sprite>& sprites) {
-  scheduler.for_each_parallel(sprites, trim_sprite);
+std::vector<PointF> get_convex_hull(const Image& levels, 
+    int threshold, int block_size) {
+  const auto outline = get_convex_outline(levels.view<RGBA::Channel>(),
+    threshold, block_size);
+  return to_point_list(*to_convex_polygon(*outline, 0));
+}
+
+TrimCache trim_sprites(std::vector<Sprite>& sprites, 
+    const TrimCache& previous_cache) {
+  auto results = TrimResults(previous_cache);
+  scheduler.for_each_parallel(sprites, 
+    [&](Sprite& sprite) { trim_sprite(sprite, results); });
+  return results.release();
 }
 
 } // namespace
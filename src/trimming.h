@@ -4,6 +4,21 @@
 
 namespace spright {
 
-void trim_sprites(std::vector<Sprite>& sprites);
+// trimmed rect relative to the source rect and the outline of a sprite
+struct TrimResult {
+  Rect trimmed_rect{ };
+  std::vector<PointF> vertices;
+};
+// trim results by content hash, restored from the manifest
+using TrimCache = std::map<uint64_t, TrimResult>;
+
+// convex hull of the outline of alpha or gray levels, which is marched
+// coarse-to-fine in blocks of block_size when it is greater than 1
+std::vector<PointF> get_convex_hull(const Image& levels, 
+  int threshold, int block_size);
+
+// returns the results of all trimmed sprites
+TrimCache trim_sprites(std::vector<Sprite>& sprites, 
+  const TrimCache& previous_cache = { });
 
 } // namespace
@@ -177,3 +177,46 @@ TEST_CASE("remove_directory") {
   CHECK(remove_directory("/", 1) == "/");
   CHECK(remove_directory("/", 2) == "/");
 }
+
+TEST_CASE("update_textfile") {
+  const auto filename = std::filesystem::temp_directory_path() / "spright-test.txt";
+  std::filesystem::remove(filename);
+  const auto large = std::string(100000, 'a');
+  auto changed = large;
+  changed.back() = 'b';
+
+  CHECK(update_textfile(filename, "text"));
+  CHECK(!update_textfile(filename, "text"));
+  CHECK(update_textfile(filename, "texts"));
+  CHECK(update_textfile(filename, large));
+  CHECK(!update_textfile(filename, large));
+  CHECK(update_textfile(filename, changed));
+  CHECK(read_textfile(filename) == changed);
+  CHECK(update_textfile(filename, ""));
+  CHECK(!update_textfile(filename, ""));
+  for (const auto& entry : std::filesystem::directory_iterator(filename.parent_path()))
+    CHECK(entry.path().filename().string().rfind("spright-test.txt.", 0) != 0);
+  std::filesystem::remove(filename);
+
+  CHECK(get_temporary_filename(filename) != get_temporary_filename(filename));
+}
+
+TEST_CASE("Hasher") {
+  const auto hash = [](std::string_view string) {
+    auto hasher = Hasher();
+    hasher.add(string.data(), string.size());
+    return hasher.value();
+  };
+  CHECK(hash("") != hash(std::string_view("\0", 1)));
+  CHECK(hash("abcdefgh") != hash("abcdefghi"));
+  CHECK(hash("abcdefghijklmnop") != hash("abcdefghijklmnoq"));
+  CHECK(hash("abcdefghijklmnop") == hash("abcdefghijklmnop"));
+
+  auto a = Hasher();
+  a.add_string("ab");
+  a.add_string("c");
+  auto b = Hasher();
+  b.add_string("a");
+  b.add_string("bc");
+  CHECK(a.value() != b.value());
+}
@@ -2,6 +2,11 @@
 #include "catch.hpp"
 #include "src/globbing.h"
 #include "src/FilenameSequence.h"
+#include "src/archive.h"
+#include "src/image.h"
+#include "src/InputParser.h"
+#include "miniz/miniz.h"
+#include <sstream>
 
 using namespace spright;
 
@@ -112,3 +117,45 @@ TEST_CASE("FilenameSequence") {
   CHECK(try_make_sequence("test01.txt", "test08.txt").count() == 8);
   CHECK(!try_make_sequence("test01.txt", "tes02.txt").is_sequence());
 }
+
+TEST_CASE("globbing - Archive") {
+  const auto path = std::filesystem::temp_directory_path() / "spright-test.zip";
+  std::filesystem::remove(path);
+  const auto image_filename = std::filesystem::temp_directory_path() / "spright-test.png";
+  const auto image = Image(5, 3, RGBA{ 255, 0, 0, 255 });
+  save_image(image, image_filename);
+  const auto png = read_textfile(image_filename);
+  std::filesystem::remove(image_filename);
+  for (const auto* name : { "sprites/a-0.png", "sprites/a-1.png", 
+                            "sprites/sub/b.png", "readme.txt",
+                            "maps/c-diffuse.png", "maps/c-normals.png" })
+    REQUIRE(mz_zip_add_mem_to_archive_file_in_place(path_to_utf8(path).c_str(),
+      name, png.data(), png.size(), nullptr, 0, MZ_DEFAULT_COMPRESSION));
+
+  CHECK(glob_filenames(path, "sprites/*.png") == 
+    std::vector<std::string>{ "sprites/a-0.png", "sprites/a-1.png" });
+  CHECK(glob_filenames(path, "**/*.png") == std::vector<std::string>{ 
+    "maps/c-diffuse.png", "maps/c-normals.png",
+    "sprites/a-0.png", "sprites/a-1.png", "sprites/sub/b.png" });
+  CHECK(glob_filenames(path / "sprites", "*") == 
+    std::vector<std::string>{ "a-0.png", "a-1.png" });
+
+  CHECK(source_exists(path / "sprites/a-1.png"));
+  CHECK(!source_exists(path / "sprites/a-2.png"));
+  CHECK(get_containing_file(path / "sprites/a-1.png") == path);
+
+  const auto loaded = load_image(path / "sprites/sub/b.png");
+  CHECK(is_identical(image, image.bounds(), loaded, loaded.bounds()));
+
+  // maps are found next to the source within the archive
+  auto input = std::stringstream("path \"" + path_to_utf8(path) + 
+    "\"\ninput \"maps/c-diffuse.png\"\n  maps -diffuse -normals");
+  auto parser = InputParser(Settings{ });
+  parser.parse(input);
+  const auto sprites = std::move(parser).sprites();
+  REQUIRE(sprites.size() == 1);
+  REQUIRE(sprites[0].maps);
+  REQUIRE(sprites[0].maps->size() == 1);
+  CHECK(sprites[0].maps->front() != nullptr);
+  std::filesystem::remove(path);
+}
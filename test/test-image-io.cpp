@@ -0,0 +1,329 @@
+
+#include "catch.hpp"
+#include "src/image.h"
+#include "src/common.h"
+#include "src/archive.h"
+
+using namespace spright;
+
+namespace {
+  Image generate_test_image(int width, int height) {
+    auto image = Image(width, height, RGBA{ });
+    const auto image_rgba = image.view<RGBA>();
+    for (auto y = 0; y < height; ++y)
+      for (auto x = 0; x < width; ++x)
+        image_rgba.value_at({ x, y }) = RGBA{
+          RGBA::to_channel(x * 7),
+          RGBA::to_channel(y * 3),
+          RGBA::to_channel((x / 4) * 64),
+          RGBA::to_channel(x < width / 2 ? 255 : (x * y) % 256)
+        };
+    return image;
+  }
+
+  bool is_identical(const Image& a, const Image& b) {
+    return (a.width() == b.width() && a.height() == b.height() &&
+      is_identical(a, a.bounds(), b, b.bounds()));
+  }
+
+  std::filesystem::path temp_filename(const char* filename) {
+    return std::filesystem::temp_directory_path() / filename;
+  }
+
+  uint64_t read_be(const std::byte* data) {
+    auto value = uint64_t{ };
+    for (auto i = 0; i < 8; ++i)
+      value = (value << 8) | std::to_integer<uint64_t>(data[i]);
+    return value;
+  }
+
+  // decodes the ETC2 individual and differential modes
+  RGBA decode_etc2_rgb(const std::byte* data, int x, int y) {
+    constexpr int modifiers[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+      { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+    const auto block = read_be(data);
+    const auto bit = [&](int index, int count = 1) {
+      return static_cast<int>((block >> index) & ((1u << count) - 1));
+    };
+    const auto differential = bit(33);
+    const auto subblock = (bit(32) ? y : x) / 2;
+    const auto pixel = x * 4 + y;
+    const auto selector = bit(16 + pixel) * 2 + bit(pixel);
+    const auto table = bit(subblock ? 34 : 37, 3);
+    const auto modifier = modifiers[table][selector & 1] * (selector & 2 ? -1 : 1);
+    auto color = RGBA{ 0, 0, 0, 255 };
+    for (auto c = 0; c < 3; ++c) {
+      const auto shift = 56 - 8 * c;
+      auto base = 0;
+      if (differential) {
+        auto code = bit(shift + 3, 5);
+        if (subblock)
+          code += (bit(shift, 3) ^ 4) - 4;
+        base = (code << 3 | code >> 2);
+      }
+      else {
+        const auto code = bit(subblock ? shift : shift + 4, 4);
+        base = (code << 4 | code);
+      }
+      color.channel(c) = RGBA::to_channel(std::clamp(base + modifier, 0, 255));
+    }
+    return color;
+  }
+
+  int decode_eac_alpha(const std::byte* data, int x, int y) {
+    constexpr int modifiers[16][8] = {
+      { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+      { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+      { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+      { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+      { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+      { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+      { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+      { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 } };
+    const auto block = read_be(data);
+    const auto base = static_cast<int>(block >> 56);
+    const auto multiplier = static_cast<int>((block >> 52) & 0xF);
+    const auto table = (block >> 48) & 0xF;
+    const auto index = (block >> (45 - 3 * (x * 4 + y))) & 0x7;
+    return std::clamp(base + modifiers[table][index] * multiplier, 0, 255);
+  }
+} // namespace
+
+TEST_CASE("image io - QOI roundtrip") {
+  const auto image = generate_test_image(67, 33);
+  const auto filename = temp_filename("spright-test.qoi");
+  save_image(image, filename);
+  const auto loaded = load_image(filename);
+  std::filesystem::remove(filename);
+  CHECK(is_identical(image, loaded));
+}
+
+TEST_CASE("image io - QOI runs") {
+  const auto image = Image(200, 3, RGBA{ 10, 20, 30, 40 });
+  const auto filename = temp_filename("spright-test-runs.qoi");
+  save_image(image, filename);
+  CHECK(std::filesystem::file_size(filename) < 40);
+  const auto loaded = load_image(filename);
+  std::filesystem::remove(filename);
+  CHECK(is_identical(image, loaded));
+}
+
+TEST_CASE("image io - Block compression") {
+  const auto image = generate_test_image(18, 9);
+  CHECK(compress_image(image, Compression::none).size() == 18 * 9 * 4);
+  CHECK(compress_image(image, Compression::bc1).size() == 5 * 3 * 8);
+  CHECK(compress_image(image, Compression::bc3).size() == 5 * 3 * 16);
+  CHECK(compress_image(image, Compression::bc7).size() == 5 * 3 * 16);
+
+  // a single color is encoded exactly
+  const auto color = RGBA{ 255, 0, 255, 255 };
+  const auto bc1 = compress_image(Image(4, 4, color), Compression::bc1);
+  CHECK(bc1[0] == std::byte{ 0x1F });
+  CHECK(bc1[1] == std::byte{ 0xF8 });
+}
+
+TEST_CASE("image io - ETC2 compression") {
+  const auto image = generate_test_image(16, 8);
+  const auto etc2 = compress_image(image, Compression::etc2);
+  const auto etc2a = compress_image(image, Compression::etc2a);
+  REQUIRE(etc2.size() == 4 * 2 * 8);
+  REQUIRE(etc2a.size() == 4 * 2 * 16);
+
+  // decoded pixels are close to the source
+  const auto image_rgba = image.view<RGBA>();
+  auto color_error = 0;
+  auto alpha_error = 0;
+  for (auto y = 0; y < image.height(); ++y)
+    for (auto x = 0; x < image.width(); ++x) {
+      const auto block = to_unsigned((y / 4) * 4 + x / 4);
+      const auto source = image_rgba.value_at({ x, y });
+      const auto color = decode_etc2_rgb(etc2.data() + block * 8, x % 4, y % 4);
+      CHECK(color == decode_etc2_rgb(etc2a.data() + block * 16 + 8, x % 4, y % 4));
+      for (auto c = 0; c < 3; ++c)
+        color_error = std::max(color_error, std::abs(color.channel(c) - source.channel(c)));
+      alpha_error = std::max(alpha_error, std::abs(source.a -
+        decode_eac_alpha(etc2a.data() + block * 16, x % 4, y % 4)));
+    }
+  CHECK(color_error <= 32);
+  CHECK(alpha_error <= 32);
+
+  // a single color is encoded within the smallest modifier
+  const auto color = RGBA{ 136, 68, 204, 128 };
+  const auto single = compress_image(Image(4, 4, color), Compression::etc2a);
+  CHECK(decode_eac_alpha(single.data(), 1, 2) == 128);
+  const auto decoded = decode_etc2_rgb(single.data() + 8, 3, 3);
+  for (auto c = 0; c < 3; ++c)
+    CHECK(std::abs(decoded.channel(c) - color.channel(c)) <= 2);
+
+  CHECK_THROWS(save_image(image, temp_filename("spright-test.dds"), Compression::etc2));
+}
+
+TEST_CASE("image io - DDS and KTX2 headers") {
+  const auto image = generate_test_image(16, 8);
+  const auto dds = temp_filename("spright-test.dds");
+  save_image(image, dds, Compression::bc3);
+  CHECK(std::filesystem::file_size(dds) == 4 + 124 + 20 + 4 * 2 * 16);
+  CHECK(read_textfile(dds).substr(0, 4) == "DDS ");
+  std::filesystem::remove(dds);
+
+  const auto ktx2 = temp_filename("spright-test.ktx2");
+  save_image(image, ktx2, Compression::bc1);
+  const auto data = read_textfile(ktx2);
+  std::filesystem::remove(ktx2);
+  CHECK(data.substr(0, 12) == "\xABKTX 20\xBB\r\n\x1A\n");
+  CHECK(data.size() % 8 == 0);
+
+  CHECK_THROWS(save_image(image, temp_filename("spright-test.png"), Compression::bc1));
+}
+
+TEST_CASE("image io - Mipmaps") {
+  const auto image = generate_test_image(10, 6);
+  const auto mipmaps = generate_mipmaps(image, 0, ResizeFilter::undefined);
+  REQUIRE(mipmaps.size() == 3);
+  CHECK(mipmaps[0].bounds() == Rect{ 0, 0, 5, 3 });
+  CHECK(mipmaps[1].bounds() == Rect{ 0, 0, 2, 1 });
+  CHECK(mipmaps[2].bounds() == Rect{ 0, 0, 1, 1 });
+  CHECK(generate_mipmaps(image, 2, ResizeFilter::undefined).size() == 1);
+  CHECK(generate_mipmaps(image, 1, ResizeFilter::undefined).empty());
+
+  const auto ktx2 = temp_filename("spright-test-mipmaps.ktx2");
+  save_image(image, ktx2, Compression::none, mipmaps);
+  const auto data = read_textfile(ktx2);
+  std::filesystem::remove(ktx2);
+  CHECK(data[40] == 4);
+
+  const auto png = temp_filename("spright-test-mipmaps.png");
+  const auto png_mip2 = temp_filename("spright-test-mipmaps-mip2.png");
+  save_image(image, png, Compression::undefined, mipmaps);
+  CHECK(load_image(png_mip2).bounds() == Rect{ 0, 0, 2, 1 });
+  for (const auto& filename : { png, png_mip2,
+      temp_filename("spright-test-mipmaps-mip1.png"),
+      temp_filename("spright-test-mipmaps-mip3.png") })
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("image io - Texture arrays") {
+  auto layers = std::vector<Image>();
+  layers.push_back(generate_test_image(8, 8));
+  layers.push_back(generate_test_image(8, 8));
+  layers.push_back(generate_test_image(8, 8));
+
+  const auto ktx2 = temp_filename("spright-test-array.ktx2");
+  save_image_array(layers, ktx2, Compression::bc1);
+  const auto data = read_textfile(ktx2);
+  std::filesystem::remove(ktx2);
+  CHECK(data[32] == 3);
+  CHECK(data.size() % 8 == 0);
+
+  const auto dds = temp_filename("spright-test-array.dds");
+  save_image_array(layers, dds, Compression::bc7);
+  CHECK(std::filesystem::file_size(dds) == 4 + 124 + 20 + 3 * 4 * 16);
+  std::filesystem::remove(dds);
+
+  layers.push_back(generate_test_image(4, 8));
+  CHECK_THROWS(save_image_array(layers, dds));
+  CHECK_THROWS(save_image_array(layers, temp_filename("spright-test-array.png")));
+}
+
+TEST_CASE("image io - Indexed PNG") {
+  auto image = Image(37, 11, RGBA{ });
+  const auto image_rgba = image.view<RGBA>();
+  const auto colors = std::array<RGBA, 5>{ {
+    { 0, 0, 0, 0 }, { 255, 0, 0, 255 }, { 0, 255, 0, 128 }, 
+    { 0, 0, 255, 255 }, { 10, 20, 30, 255 } } };
+  for (auto y = 0; y < image.height(); ++y)
+    for (auto x = 0; x < image.width(); ++x)
+      image_rgba.value_at({ x, y }) = colors[to_unsigned(x * y + x / 3) % colors.size()];
+
+  const auto filename = temp_filename("spright-test-indexed.png");
+  save_image(image, filename, Compression::undefined, { }, 256);
+  const auto data = read_textfile(filename);
+  CHECK(data[24] == 4); // bit depth
+  CHECK(data[25] == 3); // indexed color
+  CHECK(data.find("tRNS") != std::string::npos);
+  CHECK(is_identical(image, load_image(filename)));
+
+  // more colors than allowed are reduced
+  save_image(generate_test_image(67, 33), filename, 
+    Compression::undefined, { }, 4);
+  CHECK(read_textfile(filename)[24] == 2);
+  CHECK(load_image(filename).bounds() == Rect{ 0, 0, 67, 33 });
+  std::filesystem::remove(filename);
+
+  CHECK_THROWS(save_image(image, temp_filename("spright-test-indexed.bmp"), 
+    Compression::undefined, { }, 256));
+}
+
+TEST_CASE("image io - Image cache") {
+  const auto image = generate_test_image(67, 33);
+  const auto filename = temp_filename("spright-test-cached.png");
+  const auto cache_path = temp_filename("spright-test-cache");
+  std::filesystem::remove_all(cache_path);
+  save_image(image, filename);
+
+  // decoded image is stored in cache
+  CHECK(is_identical(image, load_image(filename, cache_path)));
+  auto cached = std::vector<std::filesystem::path>();
+  for (const auto& entry : std::filesystem::directory_iterator(cache_path))
+    cached.push_back(entry.path());
+  REQUIRE(cached.size() == 1);
+  CHECK(is_identical(image, load_image(filename, cache_path)));
+
+  // invalid cache file is replaced
+  write_textfile(cached[0], "invalid");
+  CHECK(is_identical(image, load_image(filename, cache_path)));
+  CHECK(std::filesystem::file_size(cached[0]) > 67 * 33 * sizeof(RGBA));
+
+  // changed file replaces its entry
+  const auto changed = generate_test_image(40, 20);
+  save_image(changed, filename);
+  std::filesystem::last_write_time(filename, 
+    std::filesystem::last_write_time(filename) + std::chrono::seconds(1));
+  CHECK(is_identical(changed, load_image(filename, cache_path)));
+  CHECK(is_identical(changed, load_image(filename, cache_path)));
+  auto entries = std::vector<std::filesystem::path>();
+  for (const auto& entry : std::filesystem::directory_iterator(cache_path))
+    entries.push_back(entry.path());
+  CHECK(entries == cached);
+  CHECK(std::filesystem::file_size(cached[0]) < 67 * 33 * sizeof(RGBA));
+
+  std::filesystem::remove(filename);
+  std::filesystem::remove_all(cache_path);
+}
+
+TEST_CASE("image io - Decode from memory") {
+  const auto image = generate_test_image(67, 33);
+  for (const auto* name : { "spright-test-decode.png", "spright-test-decode.qoi" }) {
+    const auto filename = temp_filename(name);
+    save_image(image, filename);
+    const auto data = read_textfile(filename);
+    std::filesystem::remove(filename);
+    CHECK(is_identical(image, decode_image(data)));
+  }
+  CHECK(!decode_image("invalid"));
+}
+
+TEST_CASE("image io - Output bundle") {
+  const auto image = generate_test_image(67, 33);
+  const auto filename = temp_filename("spright-test-bundle.zip");
+  const auto sprites = temp_filename("spright-test-bundle");
+  open_output_bundle(filename);
+  save_image(image, sprites / "sheet.png");
+  save_image(image, sprites / "sheet.qoi");
+  CHECK(add_to_output_bundle(sprites / "sheet.json", "{ }"));
+  CHECK(add_to_output_bundle(sprites / "../../outside.json", "{ }"));
+  close_output_bundle();
+  CHECK(!is_output_bundle_open());
+  CHECK(!add_to_output_bundle(sprites / "sheet.json", "{ }"));
+  CHECK(!std::filesystem::exists(sprites));
+
+  // entries are relative to the bundle's directory
+  const auto bundled = filename / "spright-test-bundle";
+  CHECK(is_identical(image, load_image(bundled / "sheet.png")));
+  CHECK(is_identical(image, load_image(bundled / "sheet.qoi")));
+  auto text = std::string();
+  CHECK(read_source_file(bundled / "sheet.json", text));
+  CHECK(text == "{ }");
+  CHECK(read_source_file(filename / "outside.json", text));
+  std::filesystem::remove(filename);
+}
@@ -7,6 +7,7 @@
 #include "src/output.h"
 #include "src/debug.h"
 #include <sstream>
+#include <set>
 
 using namespace spright;
 
@@ -29,15 +30,17 @@ namespace {
     return true;
   }
 
-  std::vector<Slice> pack(const char* definition) {
+  std::vector<Sprite> s_sprites;
+
+  std::vector<Slice> pack(const char* definition,
+      const PackingLayout& previous_layout = { }) {
     auto input = std::stringstream(definition);
     auto parser = InputParser(Settings{ });
     parser.parse(input);
-    static auto s_sprites = std::vector<Sprite>();
     s_sprites = std::move(parser).sprites();
     transform_sprites(s_sprites);
     trim_sprites(s_sprites);
-    auto slices = pack_sprites(s_sprites);
+    auto slices = pack_sprites(s_sprites, previous_layout);
     if (has_warnings())
       throw HasWarningsException();
     restore_untransformed_sources(s_sprites);
@@ -421,3 +424,190 @@ TEST_CASE("packing - Multiple sheets") {
   CHECK(slices[0].width <= 16);
   CHECK(slices[0].height <= 16);
 }
+
+TEST_CASE("packing - Stable") {
+  const auto definition = R"(
+    sheet "sprites"
+      padding 1
+      stable 1
+    input "test/Items.png"
+      colorkey
+      atlas
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 1);
+  auto layout = get_packing_layout(s_sprites);
+  REQUIRE(layout.size() == 1);
+  auto& sheet_layout = layout.begin()->second;
+  REQUIRE(sheet_layout.size() == s_sprites.size());
+
+  // place one sprite anew
+  const auto new_key = sheet_layout.begin()->first;
+  sheet_layout.erase(sheet_layout.begin());
+  REQUIRE_NOTHROW(slices = pack(definition, layout));
+  REQUIRE(slices.size() == 1);
+
+  const auto padded_rect = [](const Sprite& sprite) {
+    return Rect{ sprite.trimmed_rect.x - sprite.align.x,
+      sprite.trimmed_rect.y - sprite.align.y,
+      sprite.bounds.x + 1, sprite.bounds.y + 1 };
+  };
+  for (const auto& sprite : s_sprites) {
+    const auto key = get_sprite_layout_key(sprite);
+    if (key != new_key) {
+      const auto& packed = sheet_layout.at(key);
+      CHECK(packed.rect.xy() == padded_rect(sprite).xy());
+    }
+    for (const auto& other : s_sprites)
+      if (&other != &sprite)
+        CHECK(!overlapping(padded_rect(sprite), padded_rect(other)));
+  }
+}
+
+TEST_CASE("packing - Compact") {
+  const auto definition = R"(
+    sheet "sprites"
+      pack compact
+      padding 1
+      max-width 80
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim convex
+      trim-margin 1
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 1);
+  CHECK(slices[0].width <= 80);
+
+  // no pixels are shared
+  auto pixels = std::set<std::pair<int, int>>();
+  auto positions = std::vector<Point>();
+  for (const auto& sprite : s_sprites) {
+    positions.push_back(sprite.trimmed_rect.xy());
+    const auto [w, h] = sprite.trimmed_source_rect.size();
+    for (auto y = 0; y < h; ++y)
+      for (auto x = 0; x < w; ++x)
+        if (point_in_polygon(x + 0.5, y + 0.5, sprite.vertices)) {
+          const auto point = (sprite.rotated ? 
+            Point{ h - 1 - y, x } : Point{ x, y }) + sprite.trimmed_rect.xy();
+          CHECK(containing(Rect{ 0, 0, slices[0].width, slices[0].height }, point));
+          CHECK(pixels.emplace(point.x, point.y).second);
+        }
+  }
+
+  // layout is reproducible
+  REQUIRE_NOTHROW(slices = pack(definition));
+  for (auto i = size_t{ }; i < s_sprites.size(); ++i)
+    CHECK(s_sprites[i].trimmed_rect.xy() == positions[i]);
+}
+
+TEST_CASE("packing - Mipmap alignment") {
+  const auto definition = R"(
+    sheet "sprites"
+      padding 1 3
+      output "sprites.ktx2"
+        mipmaps 0 2
+    input "test/Items.png"
+      colorkey
+      atlas
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  for (const auto& sprite : s_sprites) {
+    // bounds with shape padding start at multiples of 4
+    CHECK((sprite.trimmed_rect.x - sprite.align.x) % 4 == 0);
+    CHECK((sprite.trimmed_rect.y - sprite.align.y) % 4 == 0);
+    CHECK((sprite.bounds.x + 1) % 4 == 0);
+    CHECK((sprite.bounds.y + 1) % 4 == 0);
+  }
+  // texture size is halved exactly down to the bleed-free level
+  for (const auto& slice : slices) {
+    CHECK(slice.width % 4 == 0);
+    CHECK(slice.height % 4 == 0);
+  }
+
+  REQUIRE_NOTHROW(slices = pack(R"(
+    sheet "sprites"
+      max-width 130
+      align-width 6
+      output "sprites.ktx2"
+        mipmaps 0 3
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"));
+  for (const auto& slice : slices) {
+    CHECK(slice.width % 8 == 0);
+    CHECK(slice.width <= 128);
+    CHECK(slice.height % 8 == 0);
+  }
+
+  // mipmaps are generated after scaling
+  REQUIRE_NOTHROW(slices = pack(R"(
+    sheet "sprites"
+      output "sprites.ktx2"
+        scale 0.5
+        mipmaps 0 2
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"));
+  for (const auto& sprite : s_sprites) {
+    CHECK((sprite.trimmed_rect.x - sprite.align.x) % 8 == 0);
+    CHECK((sprite.trimmed_rect.y - sprite.align.y) % 8 == 0);
+  }
+  for (const auto& slice : slices) {
+    CHECK(slice.width % 8 == 0);
+    CHECK(slice.height % 8 == 0);
+  }
+
+  CHECK_THROWS_AS(pack(R"(
+    sheet "sprites"
+      output "sprites.ktx2"
+        scale 0.75
+        mipmaps 0 2
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"), HasWarningsException);
+
+  CHECK_THROWS_AS(pack(R"(
+    sheet "sprites"
+      pack compact
+      output "sprites.ktx2"
+        mipmaps 0 2
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"), HasWarningsException);
+}
+
+TEST_CASE("packing - Compact extrude") {
+  const auto definition = R"(
+    sheet "sprites"
+      pack compact
+      max-width 80
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim rect
+      extrude 2
+      align left top
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 1);
+
+  // extruded pixels are within the slice and not shared
+  auto pixels = std::set<std::pair<int, int>>();
+  for (const auto& sprite : s_sprites) {
+    const auto rect = expand(sprite.trimmed_rect, 2);
+    CHECK(containing(Rect{ 0, 0, slices[0].width, slices[0].height }, rect));
+    for (auto y = rect.y0(); y < rect.y1(); ++y)
+      for (auto x = rect.x0(); x < rect.x1(); ++x)
+        CHECK(pixels.emplace(x, y).second);
+  }
+}
@@ -4,6 +4,8 @@
 #include "src/trimming.h"
 #include "src/packing.h"
 #include "src/output.h"
+#include "nlohmann/json.hpp"
+#include "docs/spright_binary.h"
 
 using namespace spright;
 
@@ -68,3 +70,188 @@ let sprite_ids = [{% for sprite in sprites %}"{{ removeExtension(sprite.id) }}",
 let sprite_ids = ["Items",];
 )");
 }
+
+TEST_CASE("templates - Binary description formats") {
+  const auto [sprites, slices] = pack(R"(
+    sheet "sprites"
+    input "test/Items.png"
+  )");
+  const auto directory = std::filesystem::temp_directory_path();
+  auto descriptions = std::vector<Description>();
+  for (const auto filename : { "spright-test.json", "spright-test.cbor",
+      "spright-test.msgpack", "spright-test.ubj" })
+    descriptions.push_back({ directory / filename, { }, { } });
+  complete_description_definitions(Settings{ }, descriptions, { });
+  CHECK(descriptions[1].format == DescriptionFormat::cbor);
+  CHECK(descriptions[2].format == DescriptionFormat::msgpack);
+  CHECK(descriptions[3].format == DescriptionFormat::ubjson);
+
+  output_descriptions(Settings{ }, descriptions, { }, sprites, slices, { }, { });
+  const auto json = nlohmann::json::parse(read_textfile(descriptions[0].filename));
+  const auto read_binary = [&](const Description& description) {
+    const auto data = read_textfile(description.filename);
+    return std::vector<uint8_t>(data.begin(), data.end());
+  };
+  CHECK(nlohmann::json::from_cbor(read_binary(descriptions[1])) == json);
+  CHECK(nlohmann::json::from_msgpack(read_binary(descriptions[2])) == json);
+  CHECK(nlohmann::json::from_ubjson(read_binary(descriptions[3])) == json);
+  for (const auto& description : descriptions)
+    std::filesystem::remove(description.filename);
+}
+
+TEST_CASE("templates - Streamed JSON description") {
+  const auto [sprites, slices] = pack(R"(
+    sheet "sprites"
+    input "test/Items.png"
+      grid 16 16
+      id "item_{{ index }}"
+      tag anim "idle"
+      tag "quoted \"name\""
+      data "scale" 0.5
+      data "name" "\tescaped"
+  )");
+  const auto directory = std::filesystem::temp_directory_path();
+  auto descriptions = std::vector<Description>{
+    { directory / "spright-test.json", { }, { } },
+    { directory / "spright-test.cbor", { }, { } },
+  };
+  complete_description_definitions(Settings{ }, descriptions, { });
+  const auto variables = VariantMap{ { "version", real{ 1.5 } }, { "tags", "replaced" } };
+  output_descriptions(Settings{ }, descriptions, { }, sprites, slices, { }, variables);
+
+  // streamed output is identical to dump of the DOM
+  const auto streamed = read_textfile(descriptions[0].filename);
+  const auto data = read_textfile(descriptions[1].filename);
+  const auto json = nlohmann::json::from_cbor(std::vector<uint8_t>(data.begin(), data.end()));
+  CHECK(streamed == json.dump(1, '\t'));
+  CHECK(json["tags"] == "replaced");
+  for (const auto& description : descriptions)
+    std::filesystem::remove(description.filename);
+}
+
+TEST_CASE("templates - Description per slice") {
+  const auto [sprites, slices] = pack(R"(
+    sheet "sprites"
+      max-width 64
+      max-height 64
+    input "test/Items.png"
+      grid 16 16
+  )");
+  REQUIRE(slices.size() > 1);
+  const auto directory = std::filesystem::temp_directory_path();
+  auto descriptions = std::vector<Description>{ 
+    { directory / "spright-test-{0-}.json", { }, { } } };
+  complete_description_definitions(Settings{ }, descriptions, { });
+  output_descriptions(Settings{ }, descriptions, { }, sprites, slices, { }, { });
+
+  auto sprite_count = size_t{ };
+  for (const auto& slice : slices) {
+    const auto filename = directory / 
+      ("spright-test-" + std::to_string(slice.index) + ".json");
+    const auto json = nlohmann::json::parse(read_textfile(filename));
+    std::filesystem::remove(filename);
+    REQUIRE(json["slices"].size() == 1);
+    const auto& json_sprites = json["sprites"];
+    CHECK(json_sprites.size() == slice.sprites.size());
+    for (auto i = 0u; i < json_sprites.size(); ++i) {
+      CHECK(json_sprites[i]["index"] == i);
+      CHECK(json_sprites[i]["sliceIndex"] == 0);
+    }
+    sprite_count += json_sprites.size();
+  }
+  CHECK(sprite_count == sprites.size());
+}
+
+TEST_CASE("templates - Texture array layers") {
+  const auto [sprites, slices] = pack(R"(
+    sheet "sprites"
+      pack layers
+      output "spright-test.ktx2"
+        array
+    input "test/Items.png"
+      grid 16 16
+  )");
+  REQUIRE(slices.size() == 1);
+  const auto textures = get_textures(Settings{ }, slices);
+  REQUIRE(textures.size() == 1);
+  CHECK(get_texture_layer_count(textures[0]) == to_int(sprites.size()));
+
+  const auto directory = std::filesystem::temp_directory_path();
+  auto descriptions = std::vector<Description>{ 
+    { directory / "spright-test-layers.json", { }, { } } };
+  complete_description_definitions(Settings{ }, descriptions, { });
+  output_descriptions(Settings{ }, descriptions, { }, sprites, slices, textures, { });
+  const auto json = nlohmann::json::parse(read_textfile(descriptions[0].filename));
+  std::filesystem::remove(descriptions[0].filename);
+
+  // each sprite of a layered slice is a layer of the texture array
+  const auto& json_sprites = json["sprites"];
+  REQUIRE(json_sprites.size() == sprites.size());
+  for (auto i = 0u; i < json_sprites.size(); ++i)
+    CHECK(json_sprites[i]["layer"] == i);
+  CHECK(json["textures"][0]["layers"] == sprites.size());
+}
+
+TEST_CASE("templates - Shared template") {
+  const auto [sprites, slices] = pack(R"(
+    sheet "sprites"
+      max-width 64
+      max-height 64
+    input "test/Items.png"
+      grid 16 16
+  )");
+  const auto directory = std::filesystem::temp_directory_path();
+  const auto template_filename = directory / "spright-test.inja";
+  write_textfile(template_filename, "{{ length(sprites) }}");
+  auto descriptions = std::vector<Description>{ 
+    { directory / "spright-test-all.txt", template_filename, { } },
+    { directory / "spright-test-{0-}.txt", template_filename, { } },
+  };
+  complete_description_definitions(Settings{ }, descriptions, { });
+  output_descriptions(Settings{ }, descriptions, { }, sprites, slices, { }, { });
+
+  CHECK(read_textfile(descriptions[0].filename) == std::to_string(sprites.size()));
+  for (const auto& slice : slices) {
+    const auto filename = directory / 
+      ("spright-test-" + std::to_string(slice.index) + ".txt");
+    CHECK(read_textfile(filename) == std::to_string(slice.sprites.size()));
+    std::filesystem::remove(filename);
+  }
+  std::filesystem::remove(descriptions[0].filename);
+  std::filesystem::remove(template_filename);
+}
+
+TEST_CASE("templates - Flat binary description") {
+  const auto [sprites, slices] = pack(R"(
+    sheet "sprites"
+    input "test/Items.png"
+      grid 16 16
+      id "item_{{ index }}"
+  )");
+  REQUIRE(sprites.size() > 10);
+
+  auto descriptions = std::vector<Description>{ {
+    std::filesystem::temp_directory_path() / "spright-test.bin", { }, { } } };
+  complete_description_definitions(Settings{ }, descriptions, { });
+  CHECK(descriptions[0].format == DescriptionFormat::binary);
+  output_descriptions(Settings{ }, descriptions, { }, sprites, slices, { }, { });
+  const auto data = read_textfile(descriptions[0].filename);
+  std::filesystem::remove(descriptions[0].filename);
+
+  // keep data 4-byte aligned
+  auto aligned = std::vector<uint32_t>(data.size() / 4);
+  std::memcpy(aligned.data(), data.data(), data.size());
+  const auto header = reinterpret_cast<const spright_header*>(aligned.data());
+  CHECK(header->magic == SPRIGHT_BINARY_MAGIC);
+  CHECK(header->sprite_count == sprites.size());
+  CHECK(header->hash_size == sprites.size());
+
+  const auto rects = SPRIGHT_ARRAY(header, sprite_rects, spright_rect);
+  for (const auto& sprite : sprites) {
+    const auto index = spright_find_sprite(header, sprite.id.c_str());
+    REQUIRE(index == sprite.index);
+    CHECK(rects[index].w == sprite.rect.w);
+    CHECK(rects[index].x == sprite.rect.x);
+  }
+  CHECK(spright_find_sprite(header, "unknown") == -1);
+}
@@ -0,0 +1,151 @@
+#include "catch.hpp"
+#include "src/InputParser.h"
+#include "src/trimming.h"
+#include <sstream>
+
+using namespace spright;
+
+namespace {
+  std::filesystem::path temp_filename(const char* filename) {
+    return std::filesystem::temp_directory_path() / filename;
+  }
+
+  std::vector<Sprite> parse(const std::string& definition) {
+    auto input = std::stringstream(definition);
+    auto parser = InputParser(Settings{ });
+    parser.parse(input);
+    return std::move(parser).sprites();
+  }
+
+  // parses the sprites of an image, which is saved to a temporary file
+  std::vector<Sprite> parse_image(const Image& image, const char* filename,
+      const std::string& definition) {
+    const auto path = temp_filename(filename);
+    save_image(image, path);
+    auto sprites = parse("input \"" + path_to_utf8(path) + "\"\n  " + definition);
+    std::filesystem::remove(path);
+    return sprites;
+  }
+} // namespace
+
+TEST_CASE("trimming - Polygon") {
+  // L-shaped island and a separate square
+  auto image = Image(40, 20, RGBA{ });
+  fill_rect(image, { 2, 2, 16, 4 }, RGBA{ 255, 255, 255, 255 });
+  fill_rect(image, { 2, 2, 4, 16 }, RGBA{ 255, 255, 255, 255 });
+  fill_rect(image, { 28, 8, 8, 8 }, RGBA{ 255, 255, 255, 255 });
+  auto sprites = parse_image(image, "spright-polygon.png", "trim polygon 16");
+  trim_sprites(sprites);
+  REQUIRE(sprites.size() == 1);
+  const auto& sprite = sprites[0];
+  CHECK(sprite.vertices.size() <= 16);
+
+  // covers all opaque pixels but not the concave region
+  const auto rgba = image.view<RGBA>();
+  const auto offset = sprite.trimmed_source_rect.xy();
+  for (auto y = 0; y < sprite.trimmed_source_rect.h; ++y)
+    for (auto x = 0; x < sprite.trimmed_source_rect.w; ++x)
+      if (rgba.value_at({ offset.x + x, offset.y + y }).a)
+        CHECK(point_in_polygon(x + 0.5, y + 0.5, sprite.vertices));
+  CHECK(!point_in_polygon(12 - offset.x, 12 - offset.y, sprite.vertices));
+  CHECK(!point_in_polygon(23 - offset.x, 12 - offset.y, sprite.vertices));
+}
+
+TEST_CASE("trimming - Polygon close islands") {
+  // the expanded outlines of the islands overlap
+  auto image = Image(30, 20, RGBA{ });
+  fill_rect(image, { 2, 2, 8, 8 }, RGBA{ 255, 255, 255, 255 });
+  fill_rect(image, { 13, 4, 8, 8 }, RGBA{ 255, 255, 255, 255 });
+  fill_rect(image, { 26, 2, 1, 16 }, RGBA{ 255, 255, 255, 255 });
+  auto sprites = parse_image(image, "spright-polygon-close.png", 
+    "trim polygon 24\n  trim-margin 1");
+  trim_sprites(sprites);
+  REQUIRE(sprites.size() == 1);
+  const auto& sprite = sprites[0];
+  REQUIRE(sprite.vertices.size() >= 3);
+
+  // covers all opaque pixels and stays within the trimmed rect
+  const auto rgba = image.view<RGBA>();
+  const auto offset = sprite.trimmed_source_rect.xy();
+  for (auto y = 0; y < sprite.trimmed_source_rect.h; ++y)
+    for (auto x = 0; x < sprite.trimmed_source_rect.w; ++x)
+      if (rgba.value_at({ offset.x + x, offset.y + y }).a)
+        CHECK(point_in_polygon(x + 0.5, y + 0.5, sprite.vertices));
+  for (const auto& vertex : sprite.vertices) {
+    CHECK(vertex.x >= 0);
+    CHECK(vertex.y >= 0);
+    CHECK(vertex.x <= sprite.trimmed_source_rect.w);
+    CHECK(vertex.y <= sprite.trimmed_source_rect.h);
+  }
+  CHECK(!point_in_polygon(23.5 - offset.x, 17.5 - offset.y, sprite.vertices));
+}
+
+TEST_CASE("trimming - Convex large") {
+  // a noisy disc, which is marched coarse-to-fine
+  const auto size = 800;
+  auto image = Image(size, size, RGBA{ });
+  const auto rgba = image.view<RGBA>();
+  const auto radius = 350;
+  for (auto y = 0; y < size; ++y)
+    for (auto x = 0; x < size; ++x) {
+      const auto dx = x - size / 2;
+      const auto dy = y - size / 2;
+      if (dx * dx + dy * dy < radius * radius && (x * 7 + y * 13) % 5 == 0)
+        rgba.value_at({ x, y }) = RGBA{ 255, 255, 255, 255 };
+    }
+  auto sprites = parse_image(image, "spright-convex.png", "trim convex");
+  sprites.push_back(sprites.front());
+  trim_sprites(sprites);
+  REQUIRE(sprites.size() == 2);
+  const auto& sprite = sprites[0];
+  CHECK(sprite.vertices == sprites[1].vertices);
+  CHECK(sprite.vertices.size() >= 16);
+
+  // the hull marched coarse-to-fine is the one marched at full resolution
+  const auto levels = get_alpha_levels(image);
+  const auto hull = get_convex_hull(levels, 1, 1);
+  CHECK(hull.size() >= 16);
+  CHECK(get_convex_hull(levels, 1, 4) == hull);
+  CHECK(get_convex_hull(levels, 1, 6) == hull);
+}
+
+TEST_CASE("trimming - Cache") {
+  const auto definition = R"(
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim convex
+  )";
+
+  auto sprites = parse(definition);
+  auto cache = trim_sprites(sprites);
+  // identical sprites share a result
+  CHECK(!cache.empty());
+  CHECK(cache.size() < sprites.size());
+
+  // cached results are restored
+  for (auto& [key, result] : cache) {
+    result.trimmed_rect = { 1, 2, 3, 4 };
+    result.vertices = { { 1, 1 }, { 2, 1 }, { 2, 2 } };
+  }
+  auto cached_sprites = parse(definition);
+  const auto restored_cache = trim_sprites(cached_sprites, cache);
+  CHECK(restored_cache.size() == cache.size());
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    const auto& sprite = cached_sprites[i];
+    CHECK(sprite.trimmed_source_rect.x == sprite.source_rect.x + 1);
+    CHECK(sprite.trimmed_source_rect.w == 3);
+    CHECK(sprite.vertices.size() == 3);
+  }
+
+  // trim settings are part of the key
+  auto margin_sprites = parse(R"(
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim convex
+      trim-margin 1
+  )");
+  trim_sprites(margin_sprites, cache);
+  CHECK(margin_sprites[0].vertices.size() != 3);
+}